@@ -4,6 +4,8 @@ uniform float face;
 uniform float face_pos;
 uniform float entropy;
 uniform float seed;
+uniform vec4 region; // The box's cell in its texture page, in uv coords
+uniform float cell_size; // Pixels across a cell
 
 float smoothstep(float a, float b, float t) {
 	return a + (b - a) * t * t * (3 - 2 * t);
@@ -26,8 +28,8 @@ float rand(vec2 seed) {
 
 void main(void)
 {
-	// Get the original uv coords
-	vec2 pos = gl_TexCoord[0].xy;
+	// Get the original uv coords, within the box's cell
+	vec2 pos = (gl_TexCoord[0].xy - region.xy) / region.zw;
 	vec2 uv = pos;
 
 	// Perform vertical mutation
@@ -62,8 +64,9 @@ void main(void)
 	uv.x += 2.0f * (rand(vec2(pos.x, pos.y * seed)) - 0.5f) * .002f * entropy;
 	uv.y += 2.0f * (rand(vec2(pos.y * seed, pos.x * seed)) - 0.5f) * .002f * entropy;
 
-	// Set the pixel
-	vec4 pixel = texture2D(texture, uv);
+	// Set the pixel, keeping half a texel inside the cell so smoothing doesn't blend in its neighbours
+	float inset = 0.5 / cell_size;
+	vec4 pixel = texture2D(texture, region.xy + clamp(uv, inset, 1.0 - inset) * region.zw);
 
 	// multiply it by the vertex color
 	gl_FragColor = gl_Color * pixel;
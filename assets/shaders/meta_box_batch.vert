@@ -0,0 +1,21 @@
+uniform float columns;
+varying vec3 door;
+varying vec4 region;
+
+void main() {
+
+	// transform the vertex position
+    gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;
+
+	// transform the texture coordinates
+	gl_TexCoord[0] = gl_TextureMatrix[0] * gl_MultiTexCoord0;
+
+	// the vertex color carries the per-instance door transition (t, face, face_pos)
+	door = gl_Color.rgb;
+    gl_FrontColor = vec4(1.0, 1.0, 1.0, 1.0);
+
+	// and the alpha its cell in the texture page, in uv coords (rows count up from the bottom)
+	float cell = floor(gl_Color.a * 255.0 + 0.5);
+	float row = floor(cell / columns);
+	region = vec4(cell - row * columns, columns - 1.0 - row, 1.0, 1.0) / columns;
+}
\ No newline at end of file
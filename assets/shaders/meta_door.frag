@@ -4,6 +4,7 @@ uniform float face;
 uniform float face_pos;
 //uniform float entropy;
 uniform float seed;
+uniform vec4 region; // The sprite's rect in the atlas, in uv coords
 
 float smoothstep(float a, float b, float t) {
 	return a + (b - a) * t * t * (3 - 2 * t);
@@ -15,9 +16,9 @@ float rand(vec2 seed) {
 
 void main(void)
 {
-	// Get the original uv coords
-	vec2 pos = gl_TexCoord[0].xy;
-	vec2 uv = pos;
+	// Get the original uv coords, and the position within the sprite
+	vec2 uv = gl_TexCoord[0].xy;
+	vec2 pos = (uv - region.xy) / region.zw;
 
 	// Randomize the pixel a bit
 	//uv.x += 2.0f * (rand(vec2(pos.x, pos.y * seed)) - 0.5f) * .002f * entropy;
@@ -0,0 +1,221 @@
+#include "NavCheck.h"
+#include "settings.h"
+#include <queue>
+#include <random>
+#include <functional>
+#include <stdio.h>
+
+// Checks for the pathfinder. Routes found over the portal graph, and the steps
+// along its flow fields, are compared against plain searches over every slot
+// of every box, which know nothing of the cached per-box costs.
+
+typedef std::pair<Box*, int> FlatSlot;	// box, and x * BOX_SLOTS + y in it
+
+static bool flat_passable(Box* box, int x, int y) {
+
+	// Instances walk their prototype's contents, but can't enter its children
+	Box* contents = box->prototype ? box->prototype.get() : box;
+	return !contents->blocks[x][y] && !contents->slots[x][y].child;
+}
+
+// Where a child's door is crossed from, in its parent
+static bool flat_outside_slot(shared_ptr<BoxDoor> door, int& x, int& y) {
+	auto box = door->box;
+	if (!box->slot || box->recursive) return false;
+	x = box->slot->x;
+	y = box->slot->y;
+	if (door->face == Left) x--;
+	else if (door->face == Right) x++;
+	else if (door->face == Top) y--;
+	else y++;
+	return x >= 0 && y >= 0 && x < BOX_SLOTS && y < BOX_SLOTS;
+}
+
+static int flat_route_cost(shared_ptr<Box> from, int sx, int sy, shared_ptr<Box> to, int tx, int ty) {
+	if (!flat_passable(from.get(), sx, sy)) return -1;
+
+	map<FlatSlot, int> costs;
+	typedef std::pair<int, FlatSlot> Entry;
+	std::priority_queue<Entry, vector<Entry>, std::greater<Entry>> open;
+	auto relax = [&](Box* box, int x, int y, int cost) {
+		if (!flat_passable(box, x, y)) return;
+		FlatSlot slot(box, x * BOX_SLOTS + y);
+		auto found = costs.find(slot);
+		if (found != costs.end() && found->second <= cost) return;
+		costs[slot] = cost;
+		open.push({ cost, slot });
+	};
+	relax(from.get(), sx, sy, 0);
+
+	static const int dx[4] = { 0, 1, 0, -1 };
+	static const int dy[4] = { -1, 0, 1, 0 };
+	while (!open.empty()) {
+		auto entry = open.top();
+		open.pop();
+		int cost = entry.first;
+		Box* box = entry.second.first;
+		int x = entry.second.second / BOX_SLOTS;
+		int y = entry.second.second % BOX_SLOTS;
+		if (cost > costs[entry.second]) continue;
+		if (box == to.get() && x == tx && y == ty) return cost;
+
+		// Walk to the neighbouring slots
+		for (int i = 0; i < 4; i++) {
+			int nx = x + dx[i], ny = y + dy[i];
+			if (nx >= 0 && ny >= 0 && nx < BOX_SLOTS && ny < BOX_SLOTS)
+				relax(box, nx, ny, cost + 1);
+		}
+
+		// Out through the box's own open doors, into an open adjacent door or else the parent
+		for (auto door : box->doors) {
+			if (!door || !door->slot || !door->open) continue;
+			if (door->slot->x != x || door->slot->y != y) continue;
+			auto adjacency = door->adjacency;
+			int ox, oy;
+			if (adjacency && adjacency->open)
+				relax(adjacency->box.get(), adjacency->slot->x, adjacency->slot->y, cost + NAV_DOOR_COST);
+			else if (box->parent && !box->parent->prototype && flat_outside_slot(door, ox, oy))
+				relax(box->parent.get(), ox, oy, cost + NAV_DOOR_COST);
+		}
+
+		// In through the open doors of children standing next to this slot
+		if (box->prototype) continue;
+		for (auto child : box->children) {
+			for (auto door : child->doors) {
+				int ox, oy;
+				if (!door || !door->open || !door->slot || !flat_outside_slot(door, ox, oy)) continue;
+				if (ox == x && oy == y)
+					relax(child.get(), door->slot->x, door->slot->y, cost + NAV_DOOR_COST);
+			}
+		}
+	}
+	return -1;
+}
+
+// Flat walking distances from a slot to every slot of the box
+static void flat_walk(Box* box, int sx, int sy, int distances[BOX_SLOTS][BOX_SLOTS]) {
+	for (int x = 0; x < BOX_SLOTS; x++)
+	for (int y = 0; y < BOX_SLOTS; y++)
+		distances[x][y] = -1;
+	if (!flat_passable(box, sx, sy)) return;
+
+	static const int dx[4] = { 0, 1, 0, -1 };
+	static const int dy[4] = { -1, 0, 1, 0 };
+	std::queue<std::pair<int, int>> open;
+	distances[sx][sy] = 0;
+	open.push({ sx, sy });
+	while (!open.empty()) {
+		int x = open.front().first, y = open.front().second;
+		open.pop();
+		for (int i = 0; i < 4; i++) {
+			int nx = x + dx[i], ny = y + dy[i];
+			if (nx < 0 || ny < 0 || nx >= BOX_SLOTS || ny >= BOX_SLOTS) continue;
+			if (!flat_passable(box, nx, ny) || distances[nx][ny] >= 0) continue;
+			distances[nx][ny] = distances[x][y] + 1;
+			open.push({ nx, ny });
+		}
+	}
+}
+
+static vector<shared_ptr<Box>> collect_tree(game& g) {
+	vector<shared_ptr<Box>> tree;
+	std::function<void(shared_ptr<Box>)> visit = [&](shared_ptr<Box> box) {
+		if (box->recursive) return;
+		tree.push_back(box);
+		for (auto child : box->children)
+			visit(child);
+	};
+	if (g.get_root_box())
+		visit(g.get_root_box());
+	return tree;
+}
+
+int check_routes(game& g, int queries, unsigned int seed) {
+	std::mt19937 rng(seed);
+
+	// Generated levels start with every door shut, so open one in each box
+	auto tree = collect_tree(g);
+	if (tree.empty()) return 0;
+	for (auto box : tree) {
+		vector<shared_ptr<BoxDoor>> doors;
+		for (auto door : box->doors)
+			if (door && door->slot) doors.push_back(door);
+		if (!doors.empty()) {
+			auto door = doors[rng() % doors.size()];
+			if (!door->open)
+				g.edit_slot(box, door->slot->x, door->slot->y, game::EditDoor);
+		}
+	}
+
+	// Compare routes between random slots of random boxes
+	int mismatches = 0;
+	for (int i = 0; i < queries; i++) {
+		auto from = tree[rng() % tree.size()];
+		auto to = tree[rng() % tree.size()];
+		int sx = rng() % BOX_SLOTS, sy = rng() % BOX_SLOTS;
+		int tx = rng() % BOX_SLOTS, ty = rng() % BOX_SLOTS;
+		auto route = g.find_route(from, sx, sy, to, tx, ty);
+		int expected = flat_route_cost(from, sx, sy, to, tx, ty);
+		int cost = route->found ? route->cost : -1;
+		if (cost != expected) {
+			printf("route from box %d (%d, %d) to box %d (%d, %d) costs %d, expected %d\n",
+				from->id, sx, sy, to->id, tx, ty, cost, expected);
+			mismatches++;
+		}
+	}
+	return mismatches;
+}
+
+int check_flow_fields(game& g) {
+	int mismatches = 0;
+	for (auto box : collect_tree(g)) {
+
+		// The box's own doors are headed for from inside, its children's from in front
+		vector<std::pair<shared_ptr<BoxDoor>, std::pair<int, int>>> portals;
+		for (auto door : box->doors)
+			if (door && door->slot)
+				portals.push_back({ door, { door->slot->x, door->slot->y } });
+		if (!box->prototype) {
+			for (auto child : box->children) {
+				for (auto door : child->doors) {
+					int x, y;
+					if (door && flat_outside_slot(door, x, y))
+						portals.push_back({ door, { x, y } });
+				}
+			}
+		}
+
+		for (auto& portal : portals) {
+			int distances[BOX_SLOTS][BOX_SLOTS];
+			flat_walk(box.get(), portal.second.first, portal.second.second, distances);
+
+			// From each slot, step along the flow until the door, which must take as many steps as the walk
+			bool differs = false;
+			for (int sx = 0; sx < BOX_SLOTS && !differs; sx++)
+			for (int sy = 0; sy < BOX_SLOTS && !differs; sy++) {
+				int x = sx, y = sy, taken = -1;
+				b2Vec2 direction;
+				for (int steps = 0; steps <= BOX_SLOTS * BOX_SLOTS; steps++) {
+					if (!g.get_flow_direction(box, b2Vec2((x + .5f) * BOX_METERS_PER_SLOT, (y + .5f) * BOX_METERS_PER_SLOT), portal.first, direction))
+						break;
+					if (x == portal.second.first && y == portal.second.second) {
+						taken = steps;
+						break;
+					}
+					int dx = (int)roundf(direction.x), dy = (int)roundf(direction.y);
+					if (abs(dx) + abs(dy) != 1) break;
+					x += dx;
+					y += dy;
+				}
+				if (taken != distances[sx][sy]) {
+					printf("flow toward box %d's door on face %d from (%d, %d) takes %d steps, expected %d\n",
+						portal.first->box->id, portal.first->face, sx, sy, taken, distances[sx][sy]);
+					differs = true;
+				}
+			}
+			if (differs)
+				mismatches++;
+		}
+	}
+	return mismatches;
+}
@@ -0,0 +1,14 @@
+#ifndef _NAV_CHECK_H_
+#define _NAV_CHECK_H_
+
+#include "game.h"
+
+// Opens a door in each box, then compares routes between random slots against
+// a flat search over every slot, printing any that differ. Returns how many did.
+int check_routes(game& g, int queries, unsigned int seed = 1);
+
+// Follows the flow toward every door from every slot of each box, checking
+// the steps taken against a flat walk. Returns the fields that differ.
+int check_flow_fields(game& g);
+
+#endif
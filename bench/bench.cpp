@@ -0,0 +1,266 @@
+#include "game.h"
+#include "settings.h"
+#include "NavCheck.h"
+#include <SFML/System/Clock.hpp>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <random>
+
+#define GOLDEN_CHANNEL_TOLERANCE 8		// colour difference still taken as the same pixel
+#define GOLDEN_PIXEL_TOLERANCE .001f	// share of a box's pixels allowed to differ
+
+// Counts the pixels of an image which differ from the reference image at
+// path, or returns -1 if there's no reference of the same size
+static int compare_image(const sf::Image& image, const string& path) {
+	sf::Image reference;
+	if (!reference.loadFromFile(path) || reference.getSize() != image.getSize()) return -1;
+	const sf::Uint8* a = image.getPixelsPtr();
+	const sf::Uint8* b = reference.getPixelsPtr();
+	int differing = 0;
+	for (unsigned int i = 0; i < image.getSize().x * image.getSize().y; i++, a += 4, b += 4)
+		for (int c = 0; c < 4; c++)
+			if (abs(a[c] - b[c]) > GOLDEN_CHANNEL_TOLERANCE) {
+				differing++;
+				break;
+			}
+	return differing;
+}
+
+// Describes the box tree from box down by what it holds, not by box ids, which
+// change when an instance's contents are copied out of its prototype
+static string describe_tree(shared_ptr<Box> box, int depth = 0) {
+	string text = to_string(box->target_sx) + "," + to_string(box->target_sy);
+	if (box->recursive) return text + "R";
+	for (auto door : box->doors) {
+		if (!door) continue;
+		text += " door " + to_string(door->face) + "@" + to_string(door->slot->x) + "," + to_string(door->slot->y);
+		if (door->open) text += " open";
+		if (door->adjacency)
+			text += " to " + to_string(door->adjacency->face) + "@" + to_string(door->adjacency->slot->x) + "," + to_string(door->adjacency->slot->y);
+	}
+
+	// An instance holds its prototype's contents
+	auto contents = box->prototype ? box->prototype : box;
+	text += " blocks";
+	for (int sx = 0; sx < BOX_SLOTS; sx++)
+	for (int sy = 0; sy < BOX_SLOTS; sy++)
+		if (contents->blocks[sx][sy])
+			text += " " + to_string(sx) + "," + to_string(sy);
+	if (depth > 16) return text;
+	vector<string> children;
+	for (auto child : contents->children)
+		children.push_back(describe_tree(child, depth + 1));
+	std::sort(children.begin(), children.end());
+	text += " [";
+	for (auto& child : children)
+		text += " (" + child + ")";
+	return text + " ]";
+}
+
+// Makes random editor edits, then undoes them all and redoes them all,
+// returning how many of the two passes left a different tree than expected.
+// Edits stop at half the journal's capacity, so none of them are dropped.
+static int check_journal(game& g, int edits) {
+	std::mt19937 rng(1234);
+	string before = describe_tree(g.get_root_box());
+	int made = 0;
+	for (int i = 0; i < edits && g.get_journal().get_bytes() < JOURNAL_CAPACITY / 2; i++) {
+		vector<shared_ptr<Box>> boxes(g.get_boxes().begin(), g.get_boxes().end());
+		auto box = boxes[rng() % boxes.size()];
+		int sx = rng() % BOX_SLOTS, sy = rng() % BOX_SLOTS;
+		int tool = rng() % 4;
+		if (tool < 3) {
+			made += g.edit_slot(box, sx, sy, (game::EditTool)tool);
+		} else if (box->children.size()) {
+			auto child = box->children.begin();
+			std::advance(child, rng() % box->children.size());
+			int d = rng() % 2 ? 1 : -1;
+			made += rng() % 2 ? g.edit_push(*child, d, 0) : g.edit_push(*child, 0, d);
+		}
+	}
+	string after = describe_tree(g.get_root_box());
+
+	// Every edit is one op to undo
+	int failures = 0;
+	if ((int)g.get_journal().get_undo_count() != made) {
+		printf("%13s %d edits journaled as %d ops\n", "", made, (int)g.get_journal().get_undo_count());
+		failures++;
+	}
+	for (int i = 0; i < edits; i++) g.undo();
+	if (describe_tree(g.get_root_box()) != before) {
+		printf("%13s undoing %d edits left a different tree\n", "", made);
+		failures++;
+	}
+	for (int i = 0; i < edits; i++) g.redo();
+	if (describe_tree(g.get_root_box()) != after) {
+		printf("%13s redoing %d edits left a different tree\n", "", made);
+		failures++;
+	}
+	if (!failures)
+		printf("%13s %d edits undone and redone\n", "", made);
+	return failures;
+}
+
+// Builds generated levels of increasing depth and reports how startup,
+// memory and per-frame cost grow with the number of boxes.
+//
+// With --soft, frames are drawn by the CPU rasterizer instead, which needs no
+// GPU, and the per-box cost of the last frame is listed. --png also writes
+// each box's last frame out as box_<depth>_<id>.png. --compare <dir> instead
+// checks each of those frames against the image of the same name in dir, and
+// fails the bench if any differ. bench/golden holds the images for the level
+// given by "3 1 10", checked with:
+//
+//     metabox-bench --compare bench/golden 3 1 10
+//
+// --telemetry <path.csv|path.jsonl> streams per-step and per-frame records for
+// each depth, to the path with the depth inserted before the extension.
+//
+// --nav checks the pathfinder on a second copy of each level, with a door opened
+// in every box: routes between random slots must cost the same as a flat search
+// finds, and following each door's flow field must take as many steps as a flat
+// walk there, or the bench fails.
+//
+// --journal makes random editor edits after the frames, and fails the bench
+// unless undoing them all gives back the level and redoing them gives the edits.
+//
+// usage: metabox-bench [--soft] [--png] [--compare dir] [--nav] [--journal] [--telemetry path] [breadth] [max depth] [frames] [door density] [block density] [recursion] [instancing]
+int main(int argc, char *argv[]) {
+
+	// Pull out the flags, leaving the positional arguments
+	bool soft = false;
+	bool png = false;
+	bool nav = false;
+	bool journal = false;
+	string telemetry_path;
+	string compare_dir;
+	int args = 1;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--soft")) soft = true;
+		else if (!strcmp(argv[i], "--telemetry") && i + 1 < argc) telemetry_path = argv[++i];
+		else if (!strcmp(argv[i], "--png")) soft = png = true;
+		else if (!strcmp(argv[i], "--compare") && i + 1 < argc) {
+			soft = true;
+			compare_dir = argv[++i];
+		}
+		else if (!strcmp(argv[i], "--nav")) nav = true;
+		else if (!strcmp(argv[i], "--journal")) journal = true;
+		else argv[args++] = argv[i];
+	}
+	argc = args;
+
+	// Nothing here dumps a trace, so don't pay to record one
+	trace_enable(false);
+
+	StressParams params;
+	int max_depth = 3;
+	int frames = 120;
+	if (argc > 1) params.breadth = atoi(argv[1]);
+	if (argc > 2) max_depth = atoi(argv[2]);
+	if (argc > 3) frames = atoi(argv[3]);
+	if (argc > 4) params.door_density = (float)atof(argv[4]);
+	if (argc > 5) params.block_density = (float)atof(argv[5]);
+	if (argc > 6) params.recursion = (float)atof(argv[6]);
+	if (argc > 7) params.instancing = (float)atof(argv[7]);
+
+	printf("breadth %d, doors %.2f, blocks %.2f, recursion %.2f, instancing %.2f, %d frames%s\n",
+		params.breadth, params.door_density, params.block_density, params.recursion, params.instancing, frames,
+		soft ? ", software rendering" : "");
+	printf("%6s %7s %12s %12s %10s %10s\n", "depth", "boxes", "startup ms", "bytes/box", "step ms", "draw ms");
+
+	int failures = 0;
+	for (int depth = 0; depth <= max_depth; depth++) {
+		params.depth = depth;
+		game g;
+
+		if (!telemetry_path.empty()) {
+			size_t dot = telemetry_path.rfind('.');
+			if (dot == string::npos) dot = telemetry_path.size();
+			g.telemetry.open(telemetry_path.substr(0, dot) + "_" + to_string(depth) + telemetry_path.substr(dot));
+		}
+
+		// Startup
+		sf::Clock clock;
+		g.setup(params, true, soft);
+		float startup = clock.getElapsedTime().asSeconds();
+
+		// Memory held by the whole tree
+		auto& boxes = g.get_boxes();
+		size_t bytes = 0;
+		for (auto& memory : g.get_memory_report())
+			bytes += memory.self();
+
+		// Per-frame cost
+		float dt = 1.f / 60.f;
+		float step_time = 0;
+		float draw_time = 0;
+		for (int i = 0; i < frames; i++) {
+			clock.restart();
+			g.step(dt);
+			step_time += clock.getElapsedTime().asSeconds();
+
+			clock.restart();
+			if (soft) g.draw_soft();
+			else g.draw();
+			float frame_draw_time = clock.getElapsedTime().asSeconds();
+			draw_time += frame_draw_time;
+			g.record_frame_telemetry(frame_draw_time);
+		}
+
+		printf("%6d %7d %12.2f %12zu %10.3f %10.3f\n",
+			depth, (int)boxes.size(), startup * 1000.f, bytes / boxes.size(),
+			step_time * 1000.f / frames, draw_time * 1000.f / frames);
+
+		// Per-box software rendering cost, in the order boxes finished
+		if (soft) {
+			for (auto& cost : g.get_soft_costs()) {
+				printf("%13s box %-5d %12llu fragments %10.3f ms\n",
+					"", cost.box_id, cost.fragments, cost.seconds * 1000.f);
+				char name[64];
+				snprintf(name, sizeof(name), "box_%d_%d.png", depth, cost.box_id);
+				if (png)
+					g.get_soft_texture(cost.box_id)->to_image().saveToFile(name);
+
+				// Against the known-good image
+				if (!compare_dir.empty()) {
+					auto image = g.get_soft_texture(cost.box_id)->to_image();
+					string path = compare_dir + "/" + name;
+					int differing = compare_image(image, path);
+					int allowed = (int)(image.getSize().x * image.getSize().y * GOLDEN_PIXEL_TOLERANCE);
+					if (differing < 0) {
+						printf("%13s no reference image %s\n", "", path.c_str());
+						failures++;
+					} else if (differing > allowed) {
+						printf("%13s %d pixels differ from %s\n", "", differing, path.c_str());
+						failures++;
+					}
+				}
+			}
+		}
+
+		// Routes over the portal graph against a search over every slot, in a
+		// level of its own, since the check opens doors
+		if (nav) {
+			game nav_game;
+			nav_game.setup(params, true, soft);
+			int queries = 500;
+			int mismatches = check_routes(nav_game, queries);
+			printf("%13s %d of %d routes differ from a flat search\n", "", mismatches, queries);
+			failures += mismatches;
+			mismatches = check_flow_fields(nav_game);
+			printf("%13s %d flow fields differ from a flat walk\n", "", mismatches);
+			failures += mismatches;
+			nav_game.teardown();
+		}
+
+		// Editor edits through undo and redo
+		if (journal)
+			failures += check_journal(g, 60);
+
+		g.teardown();
+	}
+
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,40 @@
+#include "AssetLoader.h"
+#include <fstream>
+#include <sstream>
+#include <stdio.h>
+
+static string read_file(const string& path) {
+	std::ifstream file(path, std::ios::binary);
+	std::stringstream contents;
+	contents << file.rdbuf();
+	return contents.str();
+}
+
+static sf::Image decode_image(const string& path) {
+	sf::Image image;
+	image.loadFromFile(path);
+	return image;
+}
+
+void AssetLoader::queue_file(const string& path) {
+	if (files.count(path)) return;
+	files[path] = std::async(std::launch::async, read_file, path).share();
+}
+
+void AssetLoader::queue_image(const string& path) {
+	if (images.count(path)) return;
+	images[path] = std::async(std::launch::async, decode_image, path).share();
+}
+
+const string& AssetLoader::get_file(const string& path) {
+	queue_file(path);
+	return files[path].get();
+}
+
+const sf::Image& AssetLoader::get_image(const string& path) {
+	queue_image(path);
+	const sf::Image& image = images[path].get();
+	if (!image.getSize().x && failed_images.insert(path).second)
+		printf("couldn't load image \"%s\"\n", path.c_str());
+	return image;
+}
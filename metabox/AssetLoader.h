@@ -0,0 +1,34 @@
+#ifndef _ASSET_LOADER_H_
+#define _ASSET_LOADER_H_
+
+#include <map>
+#include <set>
+#include <string>
+#include <future>
+#include <SFML/Graphics.hpp>
+
+using std::map;
+using std::set;
+using std::string;
+using std::shared_future;
+
+// Reads files and decodes images on worker threads as soon as they are queued.
+// Results are picked up (waiting if necessary) on the main thread, which does
+// anything touching GL. Read files stay owned by the loader, so fonts loaded
+// from memory can keep pointing into them. An image that fails to decode is
+// reported when it's picked up, and comes back empty.
+class AssetLoader {
+public:
+	void queue_file(const string& path);
+	void queue_image(const string& path);
+
+	const string& get_file(const string& path);
+	const sf::Image& get_image(const string& path);
+
+private:
+	map<string, shared_future<string>> files;
+	map<string, shared_future<sf::Image>> images;
+	set<string> failed_images;
+};
+
+#endif
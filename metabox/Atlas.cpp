@@ -0,0 +1,94 @@
+#include "Atlas.h"
+#include <algorithm>
+
+Atlas::Atlas() {
+}
+
+bool Atlas::add(const string& name, const string& path) {
+	sf::Image image;
+	if (!image.loadFromFile(path)) return false;
+	add(name, image);
+	return true;
+}
+
+void Atlas::add(const string& name, const sf::Image& image) {
+	pending.push_back({ name, image });
+}
+
+bool Atlas::build(unsigned int padding, bool upload) {
+
+	// Pack the tallest images first so each shelf wastes as little height as possible
+	std::sort(pending.begin(), pending.end(), [](const Entry& a, const Entry& b) {
+		return a.image.getSize().y > b.image.getSize().y;
+	});
+
+	// Pick a power-of-two width which fits the widest image and roughly squares the area
+	unsigned int area = 0, widest = 0;
+	for (auto& entry : pending) {
+		auto size = entry.image.getSize();
+		area += (size.x + padding * 2) * (size.y + padding * 2);
+		widest = std::max(widest, size.x + padding * 2);
+	}
+	unsigned int width = 64;
+	while (width < widest || width * width < area) width *= 2;
+
+	// Place the images on shelves, left to right
+	unsigned int x = 0, y = 0, shelf_height = 0;
+	rects.clear();
+	for (auto& entry : pending) {
+		auto size = entry.image.getSize();
+		if (x + size.x + padding * 2 > width) {
+			x = 0;
+			y += shelf_height;
+			shelf_height = 0;
+		}
+		rects[entry.name] = sf::IntRect(x + padding, y + padding, size.x, size.y);
+		x += size.x + padding * 2;
+		shelf_height = std::max(shelf_height, size.y + padding * 2);
+	}
+	unsigned int height = 64;
+	while (height < y + shelf_height) height *= 2;
+
+	// Copy the images in, extruding their edges into the padding so filtering
+	// at a region's border doesn't pick up its neighbours
+	image.create(width, height, sf::Color::Transparent);
+	for (auto& entry : pending) {
+		auto rect = rects[entry.name];
+		auto size = entry.image.getSize();
+		for (int py = -(int)padding; py < (int)(size.y + padding); py++)
+		for (int px = -(int)padding; px < (int)(size.x + padding); px++) {
+			int sx = std::min(std::max(px, 0), (int)size.x - 1);
+			int sy = std::min(std::max(py, 0), (int)size.y - 1);
+			image.setPixel(rect.left + px, rect.top + py, entry.image.getPixel(sx, sy));
+		}
+	}
+	pending.clear();
+
+	// Software-only runs have no GL context to upload to, or to ask for a size limit
+	if (!upload) return true;
+	if (width > sf::Texture::getMaximumSize() || height > sf::Texture::getMaximumSize()) return false;
+	return texture.loadFromImage(image);
+}
+
+bool Atlas::has(const string& name) const {
+	return rects.find(name) != rects.end();
+}
+
+sf::IntRect Atlas::get_rect(const string& name) const {
+	auto it = rects.find(name);
+	if (it == rects.end()) return sf::IntRect();
+	return it->second;
+}
+
+sf::FloatRect Atlas::get_uv_rect(const string& name) const {
+	auto rect = get_rect(name);
+	auto size = texture.getSize();
+	if (!size.x || !size.y) return sf::FloatRect();
+	return sf::FloatRect(
+		(float)rect.left / size.x, (float)rect.top / size.y,
+		(float)rect.width / size.x, (float)rect.height / size.y);
+}
+
+sf::Sprite Atlas::get_sprite(const string& name) const {
+	return sf::Sprite(texture, get_rect(name));
+}
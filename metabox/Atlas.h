@@ -0,0 +1,43 @@
+#ifndef _ATLAS_H_
+#define _ATLAS_H_
+
+#include <map>
+#include <vector>
+#include <string>
+#include <SFML/Graphics.hpp>
+
+using std::map;
+using std::vector;
+using std::string;
+
+// Packs many small images into a single texture at load time, so sprites can
+// be drawn from one texture and batched together. Images are added by name,
+// then build() shelf-packs them and uploads the result once.
+class Atlas {
+public:
+	Atlas();
+
+	bool add(const string& name, const string& path);
+	void add(const string& name, const sf::Image& image);
+	bool build(unsigned int padding = 2, bool upload = true);
+
+	bool has(const string& name) const;
+	sf::IntRect get_rect(const string& name) const;
+	sf::FloatRect get_uv_rect(const string& name) const;
+	sf::Sprite get_sprite(const string& name) const;
+	const sf::Texture& get_texture() const { return texture; }
+	const sf::Image& get_image() const { return image; }
+
+private:
+	struct Entry {
+		string name;
+		sf::Image image;
+	};
+
+	vector<Entry> pending;
+	map<string, sf::IntRect> rects;
+	sf::Image image;	// Kept for software rendering
+	sf::Texture texture;
+};
+
+#endif
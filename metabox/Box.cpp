@@ -6,9 +6,15 @@
 Box::Box() {
 	parent = 0;
 	texture = 0;
+	texture_cell = 0;
 	body = 0;
     world = 0;
     recursive = false;
+    prototype = 0;
+    rendered_frame = -1;
+    active = false;
+    revision = 0;
+    nav_revision = 0;
     world_edges = 0;
     slot = 0;
 
@@ -22,6 +28,7 @@ Box::Box() {
 	for (int sx = 0; sx < BOX_SLOTS; sx++)
 	for (int sy = 0; sy < BOX_SLOTS; sy++) {
 		blocks[sx][sy] = 0;
+		block_bodies[sx][sy] = 0;
 	}
 
     // Initialize slots
@@ -3,6 +3,7 @@
 
 #include "settings.h"
 #include "Entity.h"
+#include "DoorIndex.h"
 #include <Box2D/Box2D.h>
 #include <SFML/Graphics.hpp>
 #include <memory>
@@ -23,7 +24,8 @@ class Slot {
 public:
 	int x, y;
 	Box* parent;
-	shared_ptr<Box> child;
+	shared_ptr<Box> child;	// box currently in this slot
+	shared_ptr<Box> claim;	// box headed for this slot
 
     bool edges(BoxFace face) {
         return ((face == Left && x == 0) || (face == Right && x == BOX_SLOTS - 1) ||
@@ -31,6 +33,19 @@ public:
     }
 };
 
+// One step of a box push, in slots
+struct BoxMove {
+	shared_ptr<Box> box;
+	int dx, dy;
+};
+
+// A point inside a box, in that box's world
+struct BoxPoint {
+	shared_ptr<Box> box;
+	b2Vec2 position;
+	int depth;	// levels below the box the search started in
+};
+
 class BoxDoor {
 public:
 	shared_ptr<Box> box;
@@ -46,16 +61,25 @@ public:
 	BoxDoor(shared_ptr<Box> _box, BoxFace _face, bool _open, Slot* _slot) : box(_box), face(_face), open(_open), slot(_slot), t(1) {}
 };
 
+// A render texture shared by several boxes, split into a grid of cells
+class BoxTexturePage : public sf::RenderTexture {
+public:
+	unsigned int columns;	// cells per side
+
+	BoxTexturePage() : columns(1) {}
+};
+
 class Box {
 public:
 	int id;
 	shared_ptr<Box> parent;
 	list<shared_ptr<Box>> children;
     list<Entity*> entities;
-	shared_ptr<sf::RenderTexture> texture;
+	shared_ptr<BoxTexturePage> texture;	// the page holding the box's texture, shared with other boxes
+	int texture_cell;	// which cell of the page it is
 	shared_ptr<b2World> world;
-	sf::Texture* bg;
-	sf::Texture* fg;
+	sf::IntRect bg;	// Regions of the game's sprite atlas
+	sf::IntRect fg;
 	b2Body* body;
 	b2Body* world_edges;
 	b2Fixture* body_edges[4];
@@ -69,7 +93,14 @@ public:
 	int target_sx;
 	int target_sy;
 	int blocks[BOX_SLOTS][BOX_SLOTS];
+	b2Body* block_bodies[BOX_SLOTS][BOX_SLOTS];
 	bool recursive;
+	shared_ptr<Box> prototype;	// shares this box's contents, world and texture until they diverge
+	int rendered_frame;
+	bool active;	// in the game's active set, i.e. moving or animating a door
+	DoorIndex door_index;	// door anchors inside this box, by slot
+	int revision;	// bumped whenever the box or anything inside it changes
+	int nav_revision;	// bumped when its blocks, doors or children's slots change
 
 	Box();
 	//~Box();
@@ -0,0 +1,65 @@
+#include "DebugDraw.h"
+#include "settings.h"
+
+#define DEBUG_DRAW_POLYGON_COLOR sf::Color(255, 255, 255, 150)
+#define DEBUG_DRAW_EDGE_COLOR sf::Color::Green
+#define DEBUG_DRAW_CIRCLE_SEGMENTS 12
+
+DebugDraw::DebugDraw() {
+	lines.setPrimitiveType(sf::PrimitiveType::Lines);
+	SetFlags(e_shapeBit);
+}
+
+void DebugDraw::clear() {
+	lines.clear();
+	transform = sf::Transform::Identity;
+}
+
+void DebugDraw::add_line(sf::Vector2f a, sf::Vector2f b, sf::Color color) {
+	lines.append(sf::Vertex(transform.transformPoint(a), color));
+	lines.append(sf::Vertex(transform.transformPoint(b), color));
+}
+
+void DebugDraw::draw(sf::RenderTarget& target, sf::RenderStates states) const {
+	target.draw(lines, states);
+}
+
+void DebugDraw::add_world_line(const b2Vec2& a, const b2Vec2& b, sf::Color color) {
+	add_line(
+		sf::Vector2f(a.x * PIXELS_PER_METER, a.y * PIXELS_PER_METER),
+		sf::Vector2f(b.x * PIXELS_PER_METER, b.y * PIXELS_PER_METER),
+		color);
+}
+
+void DebugDraw::DrawPolygon(const b2Vec2* vertices, int32 vertexCount, const b2Color&) {
+	for (int32 i = 0; i < vertexCount; i++)
+		add_world_line(vertices[i], vertices[(i + 1) % vertexCount], DEBUG_DRAW_POLYGON_COLOR);
+}
+
+void DebugDraw::DrawSolidPolygon(const b2Vec2* vertices, int32 vertexCount, const b2Color& color) {
+	DrawPolygon(vertices, vertexCount, color);
+}
+
+void DebugDraw::DrawCircle(const b2Vec2& center, float32 radius, const b2Color&) {
+	b2Vec2 last = center + b2Vec2(radius, 0);
+	for (int i = 1; i <= DEBUG_DRAW_CIRCLE_SEGMENTS; i++) {
+		float32 angle = i * 2.f * b2_pi / (float32)DEBUG_DRAW_CIRCLE_SEGMENTS;
+		b2Vec2 next = center + radius * b2Vec2(cosf(angle), sinf(angle));
+		add_world_line(last, next, DEBUG_DRAW_POLYGON_COLOR);
+		last = next;
+	}
+}
+
+void DebugDraw::DrawSolidCircle(const b2Vec2& center, float32 radius, const b2Vec2& axis, const b2Color& color) {
+	DrawCircle(center, radius, color);
+	add_world_line(center, center + radius * axis, DEBUG_DRAW_POLYGON_COLOR);
+}
+
+void DebugDraw::DrawSegment(const b2Vec2& p1, const b2Vec2& p2, const b2Color&) {
+	add_world_line(p1, p2, DEBUG_DRAW_EDGE_COLOR);
+}
+
+void DebugDraw::DrawTransform(const b2Transform& xf) {
+	add_world_line(xf.p, xf.p + .25f * xf.q.GetXAxis(), sf::Color::Red);
+	add_world_line(xf.p, xf.p + .25f * xf.q.GetYAxis(), sf::Color::Green);
+}
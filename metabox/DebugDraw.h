@@ -0,0 +1,37 @@
+#ifndef _DEBUG_DRAW_H_
+#define _DEBUG_DRAW_H_
+
+#include <Box2D/Box2D.h>
+#include <SFML/Graphics.hpp>
+
+// Collects Box2D debug geometry (and any other editor lines) into a single
+// line list which is drawn with one call. The vertex array is kept between
+// frames so its storage is reused.
+class DebugDraw : public b2Draw, public sf::Drawable {
+public:
+	DebugDraw();
+
+	void clear();
+	bool empty() const { return !lines.getVertexCount(); }
+	void set_transform(const sf::Transform& _transform) { transform = _transform; }
+	void add_line(sf::Vector2f a, sf::Vector2f b, sf::Color color);
+
+	// sf::Drawable
+	void draw(sf::RenderTarget& target, sf::RenderStates states) const override;
+
+	// b2Draw
+	void DrawPolygon(const b2Vec2* vertices, int32 vertexCount, const b2Color& color) override;
+	void DrawSolidPolygon(const b2Vec2* vertices, int32 vertexCount, const b2Color& color) override;
+	void DrawCircle(const b2Vec2& center, float32 radius, const b2Color& color) override;
+	void DrawSolidCircle(const b2Vec2& center, float32 radius, const b2Vec2& axis, const b2Color& color) override;
+	void DrawSegment(const b2Vec2& p1, const b2Vec2& p2, const b2Color& color) override;
+	void DrawTransform(const b2Transform& xf) override;
+
+private:
+	void add_world_line(const b2Vec2& a, const b2Vec2& b, sf::Color color);
+
+	sf::VertexArray lines;
+	sf::Transform transform;
+};
+
+#endif
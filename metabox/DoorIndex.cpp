@@ -0,0 +1,61 @@
+#include "DoorIndex.h"
+#include <math.h>
+#include <algorithm>
+
+DoorIndex::DoorIndex() : dirty(true) {
+}
+
+void DoorIndex::clear() {
+	for (auto& cell : cells)
+		cell.clear();
+	door_cells.clear();
+	dirty = false;
+}
+
+int DoorIndex::get_cell_coord(float meters) const {
+
+	// Cell 0 is the ring outside the top/left walls
+	int c = (int)floorf(meters / BOX_METERS_PER_SLOT) + 1;
+	return std::min(std::max(c, 0), DOOR_INDEX_CELLS - 1);
+}
+
+void DoorIndex::set(shared_ptr<BoxDoor> door, b2Vec2 position) {
+	remove(door.get());
+	int cell = get_cell(get_cell_coord(position.x), get_cell_coord(position.y));
+	cells[cell].push_back({ door, position });
+	door_cells[door.get()] = cell;
+}
+
+void DoorIndex::remove(BoxDoor* door) {
+	auto it = door_cells.find(door);
+	if (it == door_cells.end()) return;
+	auto& cell = cells[it->second];
+	for (auto anchor = cell.begin(); anchor != cell.end(); ++anchor) {
+		if (anchor->door.get() == door) {
+			cell.erase(anchor);
+			break;
+		}
+	}
+	door_cells.erase(it);
+}
+
+shared_ptr<BoxDoor> DoorIndex::find_nearest(b2Vec2 point, float radius, float& distance) const {
+
+	// Only the cells overlapping the radius can hold a closer door
+	int x0 = get_cell_coord(point.x - radius), x1 = get_cell_coord(point.x + radius);
+	int y0 = get_cell_coord(point.y - radius), y1 = get_cell_coord(point.y + radius);
+	shared_ptr<BoxDoor> nearest = 0;
+	float nearest_sq = radius * radius;
+	for (int cy = y0; cy <= y1; cy++)
+	for (int cx = x0; cx <= x1; cx++) {
+		for (auto& anchor : cells[get_cell(cx, cy)]) {
+			float dist_sq = (anchor.position - point).LengthSquared();
+			if (dist_sq < nearest_sq) {
+				nearest = anchor.door;
+				nearest_sq = dist_sq;
+			}
+		}
+	}
+	distance = sqrtf(nearest_sq);
+	return nearest;
+}
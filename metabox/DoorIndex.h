@@ -0,0 +1,46 @@
+#ifndef _DOOR_INDEX_H_
+#define _DOOR_INDEX_H_
+
+#include "settings.h"
+#include <Box2D/Box2D.h>
+#include <memory>
+#include <vector>
+#include <map>
+using std::shared_ptr;
+using std::vector;
+using std::map;
+
+class BoxDoor;
+
+// Slots per side of the index; one more ring on each side catches anchors on the walls
+#define DOOR_INDEX_CELLS (BOX_SLOTS + 2)
+
+// A door's position, in the world of the box it's indexed in
+struct DoorAnchor {
+	shared_ptr<BoxDoor> door;
+	b2Vec2 position;
+};
+
+// Buckets the door anchors inside one box (its own doors, and the doors of its
+// children) by slot, so a nearest-door query only looks at the slots within
+// its radius rather than every door in the box.
+class DoorIndex {
+public:
+	DoorIndex();
+
+	void clear();
+	void set(shared_ptr<BoxDoor> door, b2Vec2 position);
+	void remove(BoxDoor* door);
+	shared_ptr<BoxDoor> find_nearest(b2Vec2 point, float radius, float& distance) const;
+
+	bool dirty;	// needs rebuilding from its box's doors and children
+
+private:
+	int get_cell(int cx, int cy) const { return cy * DOOR_INDEX_CELLS + cx; }
+	int get_cell_coord(float meters) const;
+
+	vector<DoorAnchor> cells[DOOR_INDEX_CELLS * DOOR_INDEX_CELLS];
+	map<BoxDoor*, int> door_cells;
+};
+
+#endif
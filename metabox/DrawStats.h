@@ -0,0 +1,32 @@
+#ifndef _DRAW_STATS_H_
+#define _DRAW_STATS_H_
+
+#include <SFML/Graphics.hpp>
+
+// Counts draw calls, and how many of them switch target or texture, as a
+// stand-in for the GL binds SFML issues underneath
+struct DrawStats {
+	int draw_calls = 0;
+	int texture_binds = 0;
+
+	void count(const sf::RenderTarget* _target, const sf::Texture* _texture) {
+		draw_calls++;
+		if (_texture && (_texture != texture || _target != target))
+			texture_binds++;
+		target = _target;
+		texture = _texture;
+	}
+
+	void reset() {
+		draw_calls = 0;
+		texture_binds = 0;
+		target = 0;
+		texture = 0;
+	}
+
+private:
+	const sf::RenderTarget* target = 0;
+	const sf::Texture* texture = 0;
+};
+
+#endif
@@ -4,6 +4,7 @@
 Entity::Entity() {
     body = 0;
     container = 0;
+    friction = FRICTION;
 }
 
 Entity::~Entity() {
@@ -46,9 +47,9 @@ void Entity::generate_body(shared_ptr<b2World> world, b2Vec2 position, b2Vec2 ve
     b2PolygonShape shape;
     shape.SetAsBox(size * .3f, size * .3f);
     auto fixture = body->CreateFixture(&shape, 1);
-    fixture->SetFriction(FRICTION);
+    fixture->SetFriction(friction);
     b2Filter filter;
     filter.categoryBits = B2_CAT_MAIN;
-    filter.maskBits = B2_CAT_MAIN;
+    filter.maskBits = B2_CAT_MAIN | B2_CAT_PORTAL;
     fixture->SetFilterData(filter);
 }
\ No newline at end of file
@@ -12,6 +12,7 @@ class Box;
 class Entity {
 public:
     b2Body* body;
+    float friction;
     shared_ptr<Box> container;
     stack<shared_ptr<Box>> recursions;
 
@@ -0,0 +1,35 @@
+#include "Journal.h"
+
+void Journal::record(const JournalOp& op) {
+
+	// A new edit forks history, so whatever was undone can't be redone
+	for (auto& redo_op : redo_ops)
+		bytes -= redo_op.bytes();
+	redo_ops.clear();
+	undo_ops.push_back(op);
+	bytes += op.bytes();
+
+	// Drop the oldest edits until the rest fit, always keeping the newest
+	while (bytes > capacity && undo_ops.size() > 1) {
+		bytes -= undo_ops.front().bytes();
+		undo_ops.pop_front();
+	}
+}
+
+void Journal::pop_undo() {
+	if (undo_ops.empty()) return;
+	redo_ops.push_back(undo_ops.back());
+	undo_ops.pop_back();
+}
+
+void Journal::pop_redo() {
+	if (redo_ops.empty()) return;
+	undo_ops.push_back(redo_ops.back());
+	redo_ops.pop_back();
+}
+
+void Journal::clear() {
+	undo_ops.clear();
+	redo_ops.clear();
+	bytes = 0;
+}
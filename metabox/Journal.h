@@ -0,0 +1,97 @@
+#ifndef _JOURNAL_H_
+#define _JOURNAL_H_
+
+#include <memory>
+#include <deque>
+#include <vector>
+using std::shared_ptr;
+
+class Box;
+class BoxDoor;
+
+#define JOURNAL_CAPACITY (16 * 1024 * 1024) // bytes of edits kept for undo and redo; the oldest are dropped past this
+
+enum JournalOpType {
+	OpAddBox = 0,	// box was added (reverts by detaching it)
+	OpMoveBox,		// box's target slot changed from sx, sy to to_sx, to_sy
+	OpSetDoor,		// box's door on face was replaced
+	OpOpenDoor,		// box's doors' open states changed
+	OpAddBlock,		// block was added to box at sx, sy
+	OpPushBoxes		// boxes in box were pushed, as the OpMoveBox moves in order
+};
+
+// One reversible edit, holding only what changed. Only the fields its type needs are set.
+struct JournalOp {
+	JournalOpType type;
+	shared_ptr<Box> box;
+	int face;
+	int sx, sy;
+	int to_sx, to_sy;
+	shared_ptr<BoxDoor> door_before;
+	shared_ptr<BoxDoor> door_after;
+	bool open_before[4];
+	bool open_after[4];
+	std::vector<JournalOp> moves;
+	shared_ptr<Box> unique;				// an instance the edit made unique first, which undo makes an instance again
+	shared_ptr<Box> prototype;			// what unique was an instance of
+	shared_ptr<Box> unique_contents;	// holds unique's own contents while it's an instance
+	size_t kept;	// bytes the op keeps alive besides itself, like a removed box's world
+
+	JournalOp(JournalOpType _type, shared_ptr<Box> _box) :
+		type(_type), box(_box), face(0), sx(0), sy(0), to_sx(0), to_sy(0),
+		open_before(), open_after(), kept(0) {}
+
+	size_t bytes() const { return sizeof(JournalOp) + moves.size() * sizeof(JournalOp) + kept; }
+};
+
+// Undo/redo stacks of edits, bounded by the memory they keep alive. The game
+// applies and reverts the ops itself; the journal only keeps them in order.
+class Journal {
+public:
+	Journal(size_t _capacity = JOURNAL_CAPACITY) : recording(false), depth(0), capacity(_capacity), bytes(0) {}
+
+	void record(const JournalOp& op);
+	const JournalOp* peek_undo() const { return undo_ops.empty() ? 0 : &undo_ops.back(); }
+	const JournalOp* peek_redo() const { return redo_ops.empty() ? 0 : &redo_ops.back(); }
+	void pop_undo();
+	void pop_redo();
+	void clear();
+	size_t get_bytes() const { return bytes; }
+	size_t get_undo_count() const { return undo_ops.size(); }
+
+	bool recording;	// only edits made while this is set are journaled (see JournalCommand)
+	int depth;		// nesting of journaled calls; only the outermost records
+
+private:
+	std::deque<JournalOp> undo_ops;
+	std::vector<JournalOp> redo_ops;
+	size_t capacity;
+	size_t bytes;	// of the ops on both stacks
+};
+
+// Marks a journaled call, and whether it's the outermost one, so an edit
+// made of other edits (add_box setting doors, say) records just once
+class JournalScope {
+public:
+	JournalScope(Journal& _journal) : journal(_journal), outer(_journal.depth++ == 0 && _journal.recording) {}
+	~JournalScope() { journal.depth--; }
+	bool is_outer() const { return outer; }
+
+private:
+	Journal& journal;
+	bool outer;
+};
+
+// Journals the edits made by one explicit editor command. Everything else,
+// like the doors step() opens and closes as the player moves, goes unrecorded.
+class JournalCommand {
+public:
+	JournalCommand(Journal& _journal, bool record = true) : journal(_journal), was_recording(_journal.recording) { journal.recording = record; }
+	~JournalCommand() { journal.recording = was_recording; }
+
+private:
+	Journal& journal;
+	bool was_recording;
+};
+
+#endif
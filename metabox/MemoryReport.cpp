@@ -0,0 +1,62 @@
+#include "MemoryReport.h"
+#include <Box2D/Dynamics/Contacts/b2PolygonContact.h>
+
+namespace {
+	const int block_sizes[b2_blockSizes] = { 16, 32, 64, 96, 128, 160, 192, 224, 256, 320, 384, 448, 512, 640 };
+
+	// Counts one allocation against the block size class that would serve it
+	void count_block(size_t size, int counts[b2_blockSizes], size_t& large) {
+		if (size > (size_t)b2_maxBlockSize) {
+			large += size;
+			return;
+		}
+		for (int i = 0; i < b2_blockSizes; i++) {
+			if (size <= (size_t)block_sizes[i]) {
+				counts[i]++;
+				return;
+			}
+		}
+	}
+}
+
+void measure_world(const b2World* world, BoxMemory& memory) {
+	if (!world) return;
+
+	memory.world = sizeof(b2World) - sizeof(b2StackAllocator);
+	memory.world_stack = sizeof(b2StackAllocator);
+
+	// Count every block allocation the world is holding
+	int counts[b2_blockSizes] = { 0 };
+	size_t large = 0;
+	for (const b2Body* body = world->GetBodyList(); body; body = body->GetNext()) {
+		count_block(sizeof(b2Body), counts, large);
+		for (const b2Fixture* fixture = body->GetFixtureList(); fixture; fixture = fixture->GetNext()) {
+			auto shape = fixture->GetShape();
+			count_block(sizeof(b2Fixture), counts, large);
+			count_block(sizeof(b2FixtureProxy) * shape->GetChildCount(), counts, large);
+			switch (shape->GetType()) {
+			case b2Shape::e_circle: count_block(sizeof(b2CircleShape), counts, large); break;
+			case b2Shape::e_edge: count_block(sizeof(b2EdgeShape), counts, large); break;
+			case b2Shape::e_polygon: count_block(sizeof(b2PolygonShape), counts, large); break;
+			case b2Shape::e_chain:
+				count_block(sizeof(b2ChainShape), counts, large);
+				count_block(sizeof(b2Vec2) * ((const b2ChainShape*)shape)->m_count, counts, large);
+				break;
+			default: break;
+			}
+		}
+	}
+	for (int i = 0; i < world->GetContactCount(); i++)
+		count_block(sizeof(b2PolygonContact), counts, large);
+
+	// Round each size class up to whole chunks
+	memory.world_blocks = large;
+	for (int i = 0; i < b2_blockSizes; i++) {
+		int per_chunk = b2_chunkSize / block_sizes[i];
+		memory.world_blocks += (size_t)((counts[i] + per_chunk - 1) / per_chunk) * b2_chunkSize;
+	}
+
+	// A dynamic tree holds 2n - 1 nodes for n proxies
+	int proxies = world->GetProxyCount();
+	memory.world_broadphase = proxies ? (size_t)(2 * proxies - 1) * sizeof(b2TreeNode) : 0;
+}
@@ -0,0 +1,37 @@
+#ifndef _MEMORY_REPORT_H_
+#define _MEMORY_REPORT_H_
+
+#include <Box2D/Box2D.h>
+#include <stddef.h>
+
+// Bytes held by one box, split by owner. An id of BOX_MEMORY_FREE_PAGES
+// stands for the texture page cells no box is using.
+#define BOX_MEMORY_FREE_PAGES -1
+
+struct BoxMemory {
+	int id;
+	int depth;
+	size_t world;			// the b2World object itself, excluding its stack allocator
+	size_t world_stack;		// the b2StackAllocator embedded in the b2World
+	size_t world_blocks;	// b2BlockAllocator chunks backing bodies, fixtures, shapes and contacts
+	size_t world_broadphase;// dynamic tree nodes
+	size_t texture;			// the box's cell of its texture page
+	size_t slots;			// slot and block grids
+	size_t box;				// the rest of the Box, its doors and child list
+	size_t entities;		// entities contained in the box
+	size_t subtree;			// self() plus all descendants
+
+	BoxMemory() : id(0), depth(0), world(0), world_stack(0), world_blocks(0), world_broadphase(0),
+		texture(0), slots(0), box(0), entities(0), subtree(0) {}
+
+	size_t self() const {
+		return world + world_stack + world_blocks + world_broadphase + texture + slots + box + entities;
+	}
+};
+
+// Box2D's allocators don't expose their usage, so world memory is
+// reconstructed from the live objects and the block allocator's size
+// classes. Chunks are never returned, so this is a floor, not a peak.
+void measure_world(const b2World* world, BoxMemory& memory);
+
+#endif
@@ -0,0 +1,283 @@
+#include "Pathfinder.h"
+#include <queue>
+#include <functional>
+#include <algorithm>
+#include <utility>
+using std::pair;
+
+Pathfinder::Pathfinder() {
+}
+
+void Pathfinder::invalidate(Box* box) {
+	box->nav_revision++;
+	routes.clear();
+}
+
+void Pathfinder::invalidate_routes() {
+	routes.clear();
+}
+
+const BoxNav& Pathfinder::get_box_nav(shared_ptr<Box> box) {
+	return get_nav(box);
+}
+
+BoxNav& Pathfinder::get_nav(shared_ptr<Box> box) {
+	auto& nav = box_navs[box->id];
+	auto contents = box->prototype ? box->prototype : box;
+	if (nav.revision != box->nav_revision || nav.contents_revision != contents->nav_revision)
+		build_box_nav(box, nav);
+	return nav;
+}
+
+void Pathfinder::walk_costs(const BoxNav& nav, int sx, int sy, int distances[BOX_SLOTS][BOX_SLOTS]) {
+	for (int x = 0; x < BOX_SLOTS; x++)
+	for (int y = 0; y < BOX_SLOTS; y++)
+		distances[x][y] = -1;
+	if (!nav.passable[sx][sy]) return;
+
+	// Breadth-first over the slot grid
+	static const int dx[4] = { 0, 1, 0, -1 };
+	static const int dy[4] = { -1, 0, 1, 0 };
+	std::queue<pair<int, int>> open;
+	distances[sx][sy] = 0;
+	open.push({ sx, sy });
+	while (!open.empty()) {
+		auto slot = open.front();
+		open.pop();
+		for (int i = 0; i < 4; i++) {
+			int x = slot.first + dx[i], y = slot.second + dy[i];
+			if (x < 0 || y < 0 || x >= BOX_SLOTS || y >= BOX_SLOTS) continue;
+			if (!nav.passable[x][y] || distances[x][y] >= 0) continue;
+			distances[x][y] = distances[slot.first][slot.second] + 1;
+			open.push({ x, y });
+		}
+	}
+}
+
+void Pathfinder::build_box_nav(shared_ptr<Box> box, BoxNav& nav) {
+	auto contents = box->prototype ? box->prototype : box;
+	nav.revision = box->nav_revision;
+	nav.contents_revision = contents->nav_revision;
+	nav.portals.clear();
+	nav.inside_portals.clear();
+	nav.outside_portals.clear();
+	nav.flow_fields.clear();
+
+	// Blocks and settled children are solid. Instances share their prototype's
+	// blocks, but its children aren't theirs to walk into, so they're leaves.
+	for (int x = 0; x < BOX_SLOTS; x++)
+	for (int y = 0; y < BOX_SLOTS; y++)
+		nav.passable[x][y] = !contents->blocks[x][y] && !contents->slots[x][y].child;
+
+	// The box's own doors
+	for (auto door : box->doors) {
+		if (!door || !door->slot) continue;
+		nav.inside_portals[door.get()] = (int)nav.portals.size();
+		nav.portals.push_back({ door, true, door->slot->x, door->slot->y });
+	}
+
+	// The doors of its children, from the slot in front of each. Recursive
+	// children are this box again, so they don't lead anywhere new.
+	if (!box->prototype) {
+		for (auto child : box->children) {
+			if (child->recursive || !child->slot) continue;
+			for (auto door : child->doors) {
+				if (!door) continue;
+				int x = child->slot->x, y = child->slot->y;
+				if (door->face == Left) x--;
+				else if (door->face == Right) x++;
+				else if (door->face == Top) y--;
+				else y++;
+				if (x < 0 || y < 0 || x >= BOX_SLOTS || y >= BOX_SLOTS) continue;
+				nav.outside_portals[door.get()] = (int)nav.portals.size();
+				nav.portals.push_back({ door, false, x, y });
+			}
+		}
+	}
+
+	// Walking costs between every pair of portals
+	int n = (int)nav.portals.size();
+	int distances[BOX_SLOTS][BOX_SLOTS];
+	nav.costs.assign(n * n, -1);
+	for (int i = 0; i < n; i++) {
+		walk_costs(nav, nav.portals[i].sx, nav.portals[i].sy, distances);
+		for (int j = 0; j < n; j++)
+			nav.costs[i * n + j] = distances[nav.portals[j].sx][nav.portals[j].sy];
+	}
+}
+
+const FlowField* Pathfinder::get_flow_field(shared_ptr<Box> box, shared_ptr<BoxDoor> door) {
+	if (!door) return 0;
+	auto& nav = get_nav(box);
+
+	// The box's own doors are crossed from inside, its children's from outside
+	auto& portals = door->box == box ? nav.inside_portals : nav.outside_portals;
+	auto portal = portals.find(door.get());
+	if (portal == portals.end()) return 0;
+
+	auto field = nav.flow_fields.find(portal->second);
+	if (field == nav.flow_fields.end()) {
+		field = nav.flow_fields.insert({ portal->second, FlowField() }).first;
+		build_flow_field(nav, nav.portals[portal->second], field->second);
+	}
+	return &field->second;
+}
+
+void Pathfinder::build_flow_field(const BoxNav& nav, const NavPortal& portal, FlowField& field) {
+
+	// Walking is symmetric, so the distances out from the portal are the distances to it
+	walk_costs(nav, portal.sx, portal.sy, field.distances);
+
+	// Each slot steps to whichever neighbour is one closer
+	static const int dx[4] = { 0, 1, 0, -1 };
+	static const int dy[4] = { -1, 0, 1, 0 };
+	for (int x = 0; x < BOX_SLOTS; x++)
+	for (int y = 0; y < BOX_SLOTS; y++) {
+		field.dx[x][y] = 0;
+		field.dy[x][y] = 0;
+		int distance = field.distances[x][y];
+		if (distance <= 0) continue;
+		for (int i = 0; i < 4; i++) {
+			int nx = x + dx[i], ny = y + dy[i];
+			if (nx < 0 || ny < 0 || nx >= BOX_SLOTS || ny >= BOX_SLOTS) continue;
+			if (field.distances[nx][ny] == distance - 1) {
+				field.dx[x][y] = dx[i];
+				field.dy[x][y] = dy[i];
+				break;
+			}
+		}
+	}
+}
+
+shared_ptr<const NavRoute> Pathfinder::find_route(shared_ptr<Box> from, int sx, int sy, shared_ptr<Box> to, int tx, int ty) {
+	auto key = std::make_tuple(from->id, sx, sy, to->id, tx, ty);
+	auto it = routes.find(key);
+	if (it != routes.end())
+		return it->second;
+
+	if (routes.size() >= NAV_ROUTE_CACHE_SIZE)
+		routes.clear();
+	auto route = shared_ptr<NavRoute>(new NavRoute());
+	search(from, sx, sy, to, tx, ty, *route);
+	routes[key] = route;
+	return route;
+}
+
+void Pathfinder::search(shared_ptr<Box> from, int sx, int sy, shared_ptr<Box> to, int tx, int ty, NavRoute& route) {
+
+	// Graph nodes are portals, named by their box and index in its nav
+	typedef pair<Box*, int> Node;
+	struct Visit {
+		int cost;
+		shared_ptr<Box> box;
+		Node previous;
+	};
+	map<Node, Visit> visits;
+	typedef pair<int, Node> Entry;
+	std::priority_queue<Entry, vector<Entry>, std::greater<Entry>> open;
+
+	// Walk from the start to the portals of its box
+	int distances[BOX_SLOTS][BOX_SLOTS];
+	auto& from_nav = get_box_nav(from);
+	walk_costs(from_nav, sx, sy, distances);
+	for (int i = 0; i < (int)from_nav.portals.size(); i++) {
+		int cost = distances[from_nav.portals[i].sx][from_nav.portals[i].sy];
+		if (cost < 0) continue;
+		Node node(from.get(), i);
+		visits[node] = { cost, from, Node(0, -1) };
+		open.push({ cost, node });
+	}
+
+	// And from the goal to the portals of its box, which is the same walk backwards
+	int best = -1;
+	if (from == to)
+		best = distances[tx][ty];
+	Node best_node(0, -1);
+	auto& to_nav = get_box_nav(to);
+	int goal_costs[BOX_SLOTS][BOX_SLOTS];
+	walk_costs(to_nav, tx, ty, goal_costs);
+	vector<int> to_costs;
+	for (auto& portal : to_nav.portals)
+		to_costs.push_back(goal_costs[portal.sx][portal.sy]);
+
+	while (!open.empty()) {
+		auto entry = open.top();
+		open.pop();
+		int cost = entry.first;
+		auto node = entry.second;
+		if (best >= 0 && cost >= best) break;
+		auto& visit = visits[node];
+		if (cost > visit.cost) continue;
+		auto box = visit.box;
+		auto& nav = get_box_nav(box);
+		auto& portal = nav.portals[node.second];
+
+		// Reaching the goal's box
+		if (box == to && to_costs[node.second] >= 0) {
+			int total = cost + to_costs[node.second];
+			if (best < 0 || total < best) {
+				best = total;
+				best_node = node;
+			}
+		}
+
+		// Find what's neighbouring this portal
+		auto relax = [&](shared_ptr<Box> next_box, int index, int next_cost) {
+			Node next(next_box.get(), index);
+			auto found = visits.find(next);
+			if (found != visits.end() && found->second.cost <= next_cost) return;
+			visits[next] = { next_cost, next_box, node };
+			open.push({ next_cost, next });
+		};
+
+		// Walk to the box's other portals
+		int n = (int)nav.portals.size();
+		for (int j = 0; j < n; j++) {
+			int walk = nav.costs[node.second * n + j];
+			if (j != node.second && walk >= 0)
+				relax(box, j, cost + walk);
+		}
+
+		// Cross the door, if it's open
+		auto door = portal.door;
+		if (!door->open) continue;
+		if (portal.inside) {
+
+			// Out into an adjacent box, or into the parent
+			auto adjacency = door->adjacency;
+			if (adjacency && adjacency->open) {
+				auto& adj_nav = get_box_nav(adjacency->box);
+				auto adj = adj_nav.inside_portals.find(adjacency.get());
+				if (adj != adj_nav.inside_portals.end())
+					relax(adjacency->box, adj->second, cost + NAV_DOOR_COST);
+			} else if (box->parent && box->slot) {
+				auto& parent_nav = get_box_nav(box->parent);
+				auto outside = parent_nav.outside_portals.find(door.get());
+				if (outside != parent_nav.outside_portals.end())
+					relax(box->parent, outside->second, cost + NAV_DOOR_COST);
+			}
+		} else {
+
+			// Into the child
+			auto& child_nav = get_box_nav(door->box);
+			auto inside = child_nav.inside_portals.find(door.get());
+			if (inside != child_nav.inside_portals.end())
+				relax(door->box, inside->second, cost + NAV_DOOR_COST);
+		}
+	}
+
+	route.found = best >= 0;
+	route.cost = best;
+	route.waypoints.clear();
+	if (!route.found) return;
+
+	// Trace the portals back to the start
+	route.waypoints.push_back({ to, tx, ty });
+	for (auto node = best_node; node.first; node = visits[node].previous) {
+		auto& visit = visits[node];
+		auto& portal = get_box_nav(visit.box).portals[node.second];
+		route.waypoints.push_back({ visit.box, portal.sx, portal.sy });
+	}
+	route.waypoints.push_back({ from, sx, sy });
+	std::reverse(route.waypoints.begin(), route.waypoints.end());
+}
@@ -0,0 +1,98 @@
+#ifndef _PATHFINDER_H_
+#define _PATHFINDER_H_
+
+#include "settings.h"
+#include "Box.h"
+#include <memory>
+#include <vector>
+#include <map>
+#include <tuple>
+using std::shared_ptr;
+using std::vector;
+using std::map;
+using std::tuple;
+
+// Cached routes kept before the route cache is flushed
+#define NAV_ROUTE_CACHE_SIZE 1024
+
+// Slot cost of walking through a door, from one side to the other
+#define NAV_DOOR_COST 1
+
+// A slot inside a box
+struct NavWaypoint {
+	shared_ptr<Box> box;
+	int sx, sy;
+};
+
+// A route from one slot to another, possibly in another box. The waypoints are
+// the start, each side of every door crossed, and the goal; between consecutive
+// waypoints in the same box the walk stays inside that box's slot grid.
+struct NavRoute {
+	bool found = false;
+	int cost = 0;	// in slots walked
+	vector<NavWaypoint> waypoints;
+};
+
+// The step toward one portal from every slot in a box, shared by everything
+// in the box heading for it
+struct FlowField {
+	int distances[BOX_SLOTS][BOX_SLOTS];	// -1 where the portal can't be reached
+	int dx[BOX_SLOTS][BOX_SLOTS];
+	int dy[BOX_SLOTS][BOX_SLOTS];
+};
+
+// Where a door can be crossed from, inside the box being navigated
+struct NavPortal {
+	shared_ptr<BoxDoor> door;
+	bool inside;	// at the door in the box's own wall, rather than outside a child's door
+	int sx, sy;
+};
+
+// One box's slot grid, reduced to the walking costs between its portals
+struct BoxNav {
+	int revision = -1;			// box's nav revision when built
+	int contents_revision = -1;	// and its prototype's, for instances
+	bool passable[BOX_SLOTS][BOX_SLOTS];
+	vector<NavPortal> portals;
+	vector<int> costs;			// portals x portals, -1 if unreachable
+	map<BoxDoor*, int> inside_portals;
+	map<BoxDoor*, int> outside_portals;
+	map<int, FlowField> flow_fields;	// by portal, built on first use
+};
+
+// Finds routes through the box tree. The abstract graph is the portals at each
+// door: within a box they're joined by cached slot-grid walking costs, and
+// across a door by NAV_DOOR_COST while it's open. A box's costs are only
+// rebuilt once its nav revision moves, i.e. its blocks, doors or children
+// have changed; routes are cached until anything on the graph changes.
+class Pathfinder {
+public:
+	Pathfinder();
+
+	// Routes are shared with the cache, so one held by a caller outlives a flush
+	shared_ptr<const NavRoute> find_route(shared_ptr<Box> from, int sx, int sy, shared_ptr<Box> to, int tx, int ty);
+	const BoxNav& get_box_nav(shared_ptr<Box> box);
+
+	// Flow toward a door in the box, either its own or one of its children's
+	const FlowField* get_flow_field(shared_ptr<Box> box, shared_ptr<BoxDoor> door);
+
+	// Blocks, doors or children in the box changed
+	void invalidate(Box* box);
+
+	// A door opened or closed, or a box moved; the per-box costs still hold
+	void invalidate_routes();
+
+	// Fills distances with the walking cost from a slot to every slot in the box
+	static void walk_costs(const BoxNav& nav, int sx, int sy, int distances[BOX_SLOTS][BOX_SLOTS]);
+
+private:
+	BoxNav& get_nav(shared_ptr<Box> box);
+	void build_box_nav(shared_ptr<Box> box, BoxNav& nav);
+	void build_flow_field(const BoxNav& nav, const NavPortal& portal, FlowField& field);
+	void search(shared_ptr<Box> from, int sx, int sy, shared_ptr<Box> to, int tx, int ty, NavRoute& route);
+
+	map<int, BoxNav> box_navs;
+	map<tuple<int, int, int, int, int, int>, shared_ptr<const NavRoute>> routes;
+};
+
+#endif
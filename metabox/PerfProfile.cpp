@@ -0,0 +1,149 @@
+#include "PerfProfile.h"
+#include "settings.h"
+#include <fstream>
+#include <sstream>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <algorithm>
+
+static time_t get_modified_time(const string& path) {
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0) return 0;
+	return info.st_mtime;
+}
+
+static string trim(const string& s) {
+	size_t begin = s.find_first_not_of(" \t\r\n");
+	if (begin == string::npos) return "";
+	size_t end = s.find_last_not_of(" \t\r\n");
+	return s.substr(begin, end - begin + 1);
+}
+
+// Numbers must be the whole value, so "60fps" or "" don't quietly read as 0
+static bool parse_float(const string& s, float& value) {
+	char* end = 0;
+	double parsed = strtod(s.c_str(), &end);
+	if (s.empty() || *end) return false;
+	value = (float)parsed;
+	return true;
+}
+
+static bool parse_int(const string& s, int& value) {
+	char* end = 0;
+	long parsed = strtol(s.c_str(), &end, 10);
+	if (s.empty() || *end) return false;
+	value = (int)parsed;
+	return true;
+}
+
+PerfProfile::PerfProfile() : modified(0) {
+	set_preset("medium");
+}
+
+bool PerfProfile::set_preset(const string& name) {
+
+	// Medium is what the game was tuned for; the others trade around it
+	if (name == "low") {
+		step_time = 1.f / 30.f;
+		velocity_iterations = 4;
+		position_iterations = 1;
+		texture_size = BOX_RENDER_SIZE / 2;
+		dynamic_resolution = true;
+		target_frame_time = 1.f / 30.f;
+	} else if (name == "medium") {
+		step_time = 1.f / 60.f;
+		velocity_iterations = 6;
+		position_iterations = 2;
+		texture_size = BOX_RENDER_SIZE;
+		dynamic_resolution = true;
+		target_frame_time = 1.f / 60.f;
+	} else if (name == "high") {
+		step_time = 1.f / 120.f;
+		velocity_iterations = 8;
+		position_iterations = 3;
+		texture_size = BOX_RENDER_SIZE;
+		dynamic_resolution = false;
+		target_frame_time = 1.f / 60.f;
+	} else {
+		return false;
+	}
+
+	// Gameplay feel is the same on every machine
+	door_speed = 3;
+	friction = FRICTION;
+	preset = name;
+	return true;
+}
+
+bool PerfProfile::set(const string& key, const string& value) {
+	if (key == "preset") return set_preset(value);
+
+	// Values that would stall the solver or leave nothing to render are refused,
+	// keeping whatever was set before
+	int i;
+	float f;
+	if (key == "step_time") {
+		if (!parse_float(value, f) || f <= 0) return false;
+		step_time = f;
+	} else if (key == "velocity_iterations") {
+		if (!parse_int(value, i) || i < 1) return false;
+		velocity_iterations = i;
+	} else if (key == "position_iterations") {
+		if (!parse_int(value, i) || i < 1) return false;
+		position_iterations = i;
+	} else if (key == "texture_size") {
+		if (!parse_int(value, i) || i < 1) return false;
+		texture_size = (unsigned int)std::min(std::max(i, PERF_TEXTURE_SIZE_MIN), BOX_RENDER_SIZE);
+	} else if (key == "dynamic_resolution") {
+		if (!parse_int(value, i)) return false;
+		dynamic_resolution = i != 0;
+	} else if (key == "target_frame_time") {
+		if (!parse_float(value, f) || f <= 0) return false;
+		target_frame_time = f;
+	} else if (key == "door_speed") {
+		if (!parse_float(value, f) || f <= 0) return false;
+		door_speed = f;
+	} else if (key == "friction") {
+		if (!parse_float(value, f) || f < 0) return false;
+		friction = f;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+bool PerfProfile::load(const string& _path) {
+	path = _path;
+	modified = get_modified_time(path);
+	std::ifstream file(path);
+	if (!file) return false;
+
+	// Start over from the preset, so keys taken out of the file revert
+	set_preset(string(preset));
+
+	// Lines are "key = value", with # comments
+	string line;
+	int number = 0;
+	while (std::getline(file, line)) {
+		number++;
+		line = trim(line.substr(0, line.find('#')));
+		if (line.empty()) continue;
+		size_t equals = line.find('=');
+		if (equals == string::npos || !set(trim(line.substr(0, equals)), trim(line.substr(equals + 1))))
+			printf("%s:%d: ignoring \"%s\"\n", path.c_str(), number, line.c_str());
+	}
+
+	// Keep the step from ever being zero
+	if (step_time < 1.f / 1000.f)
+		step_time = 1.f / 1000.f;
+	return true;
+}
+
+bool PerfProfile::reload_if_changed() {
+	if (path.empty()) return false;
+	time_t time = get_modified_time(path);
+	if (!time || time == modified) return false;
+	return load(path);
+}
@@ -0,0 +1,39 @@
+#ifndef _PERF_PROFILE_H_
+#define _PERF_PROFILE_H_
+
+#include <string>
+#include <time.h>
+using std::string;
+
+#define PERF_PROFILE_PATH "perf.cfg"
+#define PERF_TEXTURE_SIZE_MIN 16 // pixels; texture_size is clamped to this and BOX_RENDER_SIZE
+
+// Settings that trade quality for speed, tuned per machine class. A profile
+// starts from a named preset (low, medium or high) and is read from a
+// "key = value" file, which is reloaded whenever it changes on disk.
+class PerfProfile {
+public:
+	PerfProfile();
+
+	bool set_preset(const string& name);
+	bool load(const string& path);
+	bool reload_if_changed();
+
+	string preset;
+	float step_time;			// seconds per physics step
+	int velocity_iterations;
+	int position_iterations;
+	unsigned int texture_size;	// box texture pixels before dynamic resolution
+	bool dynamic_resolution;
+	float target_frame_time;
+	float door_speed;			// door openings per second
+	float friction;
+
+private:
+	bool set(const string& key, const string& value);
+
+	string path;
+	time_t modified;
+};
+
+#endif
@@ -0,0 +1,50 @@
+#include "PortalListener.h"
+#include "Box.h"
+#include "settings.h"
+
+bool PortalListener::get_portal(b2Contact* contact, PortalContact& portal) {
+
+	// Only portal sensors are interesting, and only entities can touch them
+	b2Fixture* sensor = contact->GetFixtureA();
+	b2Fixture* other = contact->GetFixtureB();
+	if (!(sensor->GetFilterData().categoryBits & B2_CAT_PORTAL))
+		std::swap(sensor, other);
+	if (!(sensor->GetFilterData().categoryBits & B2_CAT_PORTAL)) return false;
+
+	// The sensor knows its box. Exit portals live on the box's world edges, not its body.
+	portal.box = (Box*)sensor->GetUserData();
+	portal.entity = (Entity*)other->GetBody()->GetUserData();
+	portal.exit = sensor->GetBody() != portal.box->body;
+	portal.touching = 0;
+	return portal.box && portal.entity;
+}
+
+void PortalListener::BeginContact(b2Contact* contact) {
+	PortalContact portal;
+	if (!get_portal(contact, portal)) return;
+
+	// Count overlapping fixtures, so the contact only ends with the last one
+	for (auto& existing : contacts) {
+		if (existing.entity == portal.entity && existing.box == portal.box && existing.exit == portal.exit) {
+			existing.touching++;
+			return;
+		}
+	}
+	portal.touching = 1;
+	contacts.push_back(portal);
+}
+
+void PortalListener::EndContact(b2Contact* contact) {
+	PortalContact portal;
+	if (!get_portal(contact, portal)) return;
+	for (auto it = contacts.begin(); it != contacts.end(); ++it) {
+		if (it->entity == portal.entity && it->box == portal.box && it->exit == portal.exit) {
+			if (--it->touching <= 0) contacts.erase(it);
+			return;
+		}
+	}
+}
+
+void PortalListener::forget(Box* box) {
+	contacts.remove_if([box](const PortalContact& portal) { return portal.box == box; });
+}
@@ -0,0 +1,39 @@
+#ifndef _PORTAL_LISTENER_H_
+#define _PORTAL_LISTENER_H_
+
+#include <Box2D/Box2D.h>
+#include <list>
+
+using std::list;
+
+class Box;
+class Entity;
+
+// An entity touching one of a box's door portals. Exit portals sit just
+// outside a box's open doors, in its own world; enter portals cover a child
+// box's hull, in its parent's world.
+struct PortalContact {
+	Entity* entity;
+	Box* box;
+	bool exit;
+	int touching;
+};
+
+// Sensor fixtures on door portals report here as entities touch them, so
+// transitions only need checking for entities that are actually in a doorway.
+// One listener is shared by every box world.
+class PortalListener : public b2ContactListener {
+public:
+	void BeginContact(b2Contact* contact) override;
+	void EndContact(b2Contact* contact) override;
+
+	const list<PortalContact>& get_contacts() const { return contacts; }
+	void forget(Box* box);
+
+private:
+	bool get_portal(b2Contact* contact, PortalContact& portal);
+
+	list<PortalContact> contacts;
+};
+
+#endif
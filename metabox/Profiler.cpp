@@ -0,0 +1,84 @@
+#include "Profiler.h"
+#include <algorithm>
+
+Profiler::Profiler() {
+	detailed = false;
+	frame_index = 0;
+	for (int i = 0; i < PROFILER_HISTORY; i++)
+		frame_times[i] = 0;
+}
+
+void Profiler::begin_frame() {
+	frame_clock.restart();
+	sections.clear();
+	nested.clear();
+}
+
+void Profiler::end_frame() {
+
+	// Record the frame time into the history ring
+	frame_index = (frame_index + 1) % PROFILER_HISTORY;
+	frame_times[frame_index] = frame_clock.getElapsedTime().asSeconds();
+
+	// Keep this frame's sections around for display
+	last_sections.swap(sections);
+}
+
+void Profiler::push() {
+	nested.push_back(0);
+}
+
+void Profiler::pop(const string& name, float seconds) {
+	if (nested.empty()) return;
+
+	// Subtract the time spent in nested sections from this one
+	float nested_time = nested.back();
+	nested.pop_back();
+	if (!nested.empty())
+		nested.back() += seconds;
+
+	auto& section = sections[name];
+	section.name = name;
+	section.total += seconds;
+	section.self += seconds - nested_time;
+	section.calls++;
+}
+
+void Profiler::add(const string& name, float seconds) {
+	auto& section = sections[name];
+	section.name = name;
+	section.total += seconds;
+	section.self += seconds;
+	section.calls++;
+}
+
+vector<ProfileSection> Profiler::get_worst(int count) const {
+	vector<ProfileSection> worst;
+	for (auto& section : last_sections)
+		worst.push_back(section.second);
+	std::sort(worst.begin(), worst.end(), [](const ProfileSection& a, const ProfileSection& b) {
+		return a.self > b.self;
+	});
+	if ((int)worst.size() > count)
+		worst.resize(count);
+	return worst;
+}
+
+float Profiler::get_frame_time(int frames_ago) const {
+	int i = ((frame_index - frames_ago) % PROFILER_HISTORY + PROFILER_HISTORY) % PROFILER_HISTORY;
+	return frame_times[i];
+}
+
+float Profiler::get_frame_time_max() const {
+	float max_time = 0;
+	for (int i = 0; i < PROFILER_HISTORY; i++)
+		max_time = std::max(max_time, frame_times[i]);
+	return max_time;
+}
+
+float Profiler::get_frame_time_avg() const {
+	float sum = 0;
+	for (int i = 0; i < PROFILER_HISTORY; i++)
+		sum += frame_times[i];
+	return sum / (float)PROFILER_HISTORY;
+}
@@ -0,0 +1,89 @@
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+#include "Trace.h"
+#include <SFML/System/Clock.hpp>
+#include <map>
+#include <string>
+#include <vector>
+using std::map;
+using std::string;
+using std::vector;
+
+#define PROFILER_HISTORY 120 // frames
+
+// Accumulated timing of a named phase over one frame
+struct ProfileSection {
+	string name;
+	float total;	// seconds, including nested sections
+	float self;		// seconds, excluding nested sections
+	int calls;
+};
+
+class Profiler {
+public:
+	Profiler();
+
+	void begin_frame();
+	void end_frame();
+
+	// Timers opened while another is running are nested inside it, so that
+	// self-time only counts what the section did on its own.
+	void push();
+	void pop(const string& name, float seconds);
+
+	// Add time measured elsewhere (e.g. from b2World::GetProfile)
+	void add(const string& name, float seconds);
+
+	const map<string, ProfileSection>& get_sections() const { return last_sections; }
+
+	bool detailed;	// also time the per-box sections, which run for every box every frame
+	vector<ProfileSection> get_worst(int count) const;
+	float get_frame_time(int frames_ago) const;
+	float get_frame_time_max() const;
+	float get_frame_time_avg() const;
+
+private:
+	sf::Clock frame_clock;
+	map<string, ProfileSection> sections;
+	map<string, ProfileSection> last_sections;
+	vector<float> nested;
+	float frame_times[PROFILER_HISTORY];
+	int frame_index;
+};
+
+// Times the enclosing scope into a profiler section and a trace span. A detail
+// scope is only timed into the profiler while it's detailed, and neither
+// costs anything once tracing is off too.
+class ProfileScope {
+public:
+	ProfileScope(Profiler& _profiler, const char* _name, int _id = -1, bool detail = false) :
+		profiler(_profiler), name(_name), id(_id),
+		profiled(!detail || _profiler.detailed), traced(trace_is_enabled()),
+		start(profiled || traced ? trace_now() : 0) {
+		if (profiled) profiler.push();
+	}
+	~ProfileScope() {
+		if (!profiled && !traced) return;
+		long long duration = trace_now() - start;
+		if (profiled) profiler.pop(name, duration * .000001f);
+		if (traced) trace_record(name, start, duration, id);
+	}
+
+private:
+	Profiler& profiler;
+	const char* name;
+	int id;
+	bool profiled;
+	bool traced;
+	long long start;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(profiler, name) ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(profiler, name)
+
+// One section for every box under the same name, with the box's id only kept in the trace
+#define PROFILE_BOX_SCOPE(profiler, name, id) ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(profiler, name, id, true)
+
+#endif
@@ -0,0 +1,34 @@
+#include "RenderScale.h"
+#include <math.h>
+#include <algorithm>
+
+RenderScale::RenderScale(float _target_frame_time) :
+	enabled(true),
+	scale(1),
+	target_frame_time(_target_frame_time),
+	average_frame_time(_target_frame_time),
+	average_render_time(0),
+	cooldown(RENDER_SCALE_COOLDOWN) {
+}
+
+bool RenderScale::update(float frame_time, float render_time) {
+
+	// Smooth out single-frame spikes
+	average_frame_time += (frame_time - average_frame_time) * .1f;
+	average_render_time += (render_time - average_render_time) * .1f;
+	if (!enabled || cooldown-- > 0) return false;
+
+	// Drop quickly when over budget, and creep back up when there's headroom
+	float new_scale = scale;
+	if (average_frame_time > target_frame_time * 1.1f && average_render_time > average_frame_time * .25f)
+		new_scale = scale - 2 * RENDER_SCALE_STEP;
+	else if (average_frame_time < target_frame_time * .8f)
+		new_scale = scale + RENDER_SCALE_STEP;
+	new_scale = std::min(std::max(new_scale, RENDER_SCALE_MIN), 1.f);
+	new_scale = roundf(new_scale / RENDER_SCALE_STEP) * RENDER_SCALE_STEP;
+	if (new_scale == scale) return false;
+
+	scale = new_scale;
+	cooldown = RENDER_SCALE_COOLDOWN;
+	return true;
+}
@@ -0,0 +1,31 @@
+#ifndef _RENDER_SCALE_H_
+#define _RENDER_SCALE_H_
+
+#define RENDER_SCALE_MIN .25f
+#define RENDER_SCALE_STEP (1.f / 16.f)	// scales are quantized so textures aren't resized every frame
+#define RENDER_SCALE_COOLDOWN 30		// frames to let a new scale settle before judging it
+
+// Picks the resolution box textures are rendered at, to hold a target frame
+// time. The scale only drops while rendering (drawing and presenting, which
+// waits on the GPU) is a real share of the frame; lowering resolution can't
+// help a frame that's all physics.
+class RenderScale {
+public:
+	RenderScale(float target_frame_time = 1.f / 60.f);
+
+	bool update(float frame_time, float render_time);
+	float get_scale() const { return scale; }
+	float get_target_frame_time() const { return target_frame_time; }
+	void set_target_frame_time(float _target_frame_time) { target_frame_time = _target_frame_time; }
+
+	bool enabled;
+
+private:
+	float scale;
+	float target_frame_time;
+	float average_frame_time;
+	float average_render_time;
+	int cooldown;
+};
+
+#endif
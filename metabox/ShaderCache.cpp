@@ -0,0 +1,157 @@
+#include "ShaderCache.h"
+#include <SFML/OpenGL.hpp>
+#include <fstream>
+#include <vector>
+#include <stdio.h>
+
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+#define SHADER_CACHE_EXTENSION ".shaderbin"
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT_ 0x8257
+#define GL_PROGRAM_BINARY_LENGTH_ 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS_ 0x87FE
+#define GL_LINK_STATUS_ 0x8B82
+
+// GL entry points past 1.1, which have to be looked up at runtime
+typedef void (APIENTRY *GetProgramBinaryProc)(GLuint, GLsizei, GLsizei*, GLenum*, void*);
+typedef void (APIENTRY *ProgramBinaryProc)(GLuint, GLenum, const void*, GLsizei);
+typedef void (APIENTRY *ProgramParameteriProc)(GLuint, GLenum, GLint);
+typedef void (APIENTRY *GetProgramivProc)(GLuint, GLenum, GLint*);
+typedef void (APIENTRY *LinkProgramProc)(GLuint);
+
+static GetProgramBinaryProc glGetProgramBinary_ = 0;
+static ProgramBinaryProc glProgramBinary_ = 0;
+static ProgramParameteriProc glProgramParameteri_ = 0;
+static GetProgramivProc glGetProgramiv_ = 0;
+static LinkProgramProc glLinkProgram_ = 0;
+
+// A program to compile in place of the real one on a hit. It only exists so
+// sf::Shader owns a program object for the binary to be loaded into.
+static const char* stub_vertex = "void main() { gl_Position = gl_Vertex; }";
+static const char* stub_fragment = "void main() { gl_FragColor = vec4(1.0); }";
+
+static unsigned long long hash_string(unsigned long long hash, const string& s) {
+
+	// FNV-1a, with a separator so neighbouring strings can't run together
+	for (unsigned char c : s) {
+		hash ^= c;
+		hash *= 1099511628211ull;
+	}
+	hash ^= 0xff;
+	hash *= 1099511628211ull;
+	return hash;
+}
+
+static string gl_string(GLenum name) {
+	auto s = (const char*)glGetString(name);
+	return s ? string(s) : string();
+}
+
+ShaderCache::ShaderCache() :
+	functions_loaded(false),
+	supported(false),
+	hits(0),
+	misses(0) {
+}
+
+bool ShaderCache::load(sf::Shader& shader, const string& name, const string& vertex, const string& fragment) {
+
+	// Without a context or the program binary entry points, just compile
+	if (!sf::Context::getActiveContextId() || !load_functions()) {
+		misses++;
+		return shader.loadFromMemory(vertex, fragment);
+	}
+
+	// Try the cached binary first
+	auto path = get_path(name, vertex, fragment);
+	if (load_binary(shader, path)) {
+		hits++;
+		return true;
+	}
+
+	// Fall back to compiling, and save the result for next time
+	misses++;
+	if (!shader.loadFromMemory(vertex, fragment)) return false;
+	save_binary(shader, path);
+	return true;
+}
+
+bool ShaderCache::load_functions() {
+	if (functions_loaded) return supported;
+	functions_loaded = true;
+
+	glGetProgramBinary_ = (GetProgramBinaryProc)sf::Context::getFunction("glGetProgramBinary");
+	glProgramBinary_ = (ProgramBinaryProc)sf::Context::getFunction("glProgramBinary");
+	glProgramParameteri_ = (ProgramParameteriProc)sf::Context::getFunction("glProgramParameteri");
+	glGetProgramiv_ = (GetProgramivProc)sf::Context::getFunction("glGetProgramiv");
+	glLinkProgram_ = (LinkProgramProc)sf::Context::getFunction("glLinkProgram");
+	supported = glGetProgramBinary_ && glProgramBinary_ && glProgramParameteri_ && glGetProgramiv_ && glLinkProgram_;
+
+	// Drivers may expose the calls but support no binary formats at all
+	if (supported) {
+		GLint formats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS_, &formats);
+		supported = formats > 0;
+	}
+	return supported;
+}
+
+string ShaderCache::get_path(const string& name, const string& vertex, const string& fragment) {
+
+	// Binaries are only valid for the exact driver that produced them
+	unsigned long long hash = 14695981039346656037ull;
+	hash = hash_string(hash, vertex);
+	hash = hash_string(hash, fragment);
+	hash = hash_string(hash, gl_string(GL_VENDOR));
+	hash = hash_string(hash, gl_string(GL_RENDERER));
+	hash = hash_string(hash, gl_string(GL_VERSION));
+
+	char hex[17];
+	snprintf(hex, sizeof(hex), "%016llx", hash);
+	return name + "." + hex + SHADER_CACHE_EXTENSION;
+}
+
+bool ShaderCache::load_binary(sf::Shader& shader, const string& path) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file) return false;
+
+	// The file is the binary format followed by the program binary
+	GLenum format = 0;
+	file.read((char*)&format, sizeof(format));
+	std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	if (!file.eof() || binary.empty()) return false;
+
+	// Load it over a stub program, and reject it if the driver won't link it
+	if (!shader.loadFromMemory(stub_vertex, stub_fragment)) return false;
+	GLuint program = shader.getNativeHandle();
+	glProgramBinary_(program, format, binary.data(), (GLsizei)binary.size());
+	GLint linked = 0;
+	glGetProgramiv_(program, GL_LINK_STATUS_, &linked);
+	return linked != 0;
+}
+
+void ShaderCache::save_binary(sf::Shader& shader, const string& path) {
+	GLuint program = shader.getNativeHandle();
+
+	// sf::Shader links without asking for a retrievable binary, so relink with the hint
+	glProgramParameteri_(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT_, GL_TRUE);
+	glLinkProgram_(program);
+	GLint linked = 0;
+	glGetProgramiv_(program, GL_LINK_STATUS_, &linked);
+	if (!linked) return;
+
+	GLint length = 0;
+	glGetProgramiv_(program, GL_PROGRAM_BINARY_LENGTH_, &length);
+	if (length <= 0) return;
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	GLsizei written = 0;
+	glGetProgramBinary_(program, length, &written, &format, binary.data());
+	if (written <= 0) return;
+
+	std::ofstream file(path, std::ios::binary);
+	file.write((const char*)&format, sizeof(format));
+	file.write(binary.data(), written);
+}
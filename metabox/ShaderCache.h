@@ -0,0 +1,33 @@
+#ifndef _SHADER_CACHE_H_
+#define _SHADER_CACHE_H_
+
+#include <string>
+#include <SFML/Graphics.hpp>
+
+using std::string;
+
+// Keeps linked shader program binaries on disk, keyed by a hash of the shader
+// sources and the GL driver strings. A hit loads the binary into the shader's
+// program instead of compiling; anything else compiles from source as usual,
+// then saves the result for the next start.
+class ShaderCache {
+public:
+	ShaderCache();
+
+	bool load(sf::Shader& shader, const string& name, const string& vertex, const string& fragment);
+	int get_hits() const { return hits; }
+	int get_misses() const { return misses; }
+
+private:
+	bool load_functions();
+	string get_path(const string& name, const string& vertex, const string& fragment);
+	bool load_binary(sf::Shader& shader, const string& path);
+	void save_binary(sf::Shader& shader, const string& path);
+
+	bool functions_loaded;
+	bool supported;
+	int hits;
+	int misses;
+};
+
+#endif
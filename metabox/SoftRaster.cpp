@@ -0,0 +1,145 @@
+#include "SoftRaster.h"
+#include <math.h>
+#include <algorithm>
+
+// Ports of the shader helpers. These stay in float so they land on the
+// same texels as the GPU.
+static float expand_parallel_axis(float t, float x, float y, float y0) {
+	return (2*y-3*t*t*x*x*(-3+2*x)*(-1+14*y0) + 2*t*t*t*x*x*(-3+2*x)*(-1+14*y0)) /
+		   (2-36*t*t*x*x*(-3+2*x) + 24*t*t*t*x*x*(-3+2*x));
+}
+
+static float expand_perpendicular_axis(float t, float x) {
+	if (t < .0001f) return x;
+	return (1 - 3*t*t + 2*t*t*t - sqrtf((t-1)*(t-1)*(t-1)*(t-1) * (1+2*t)*(1+2*t) + 4*(3-2*t)*t*t*x)) /
+		   (2*t*t*(-3+2*t));
+}
+
+static float fract(float x) {
+	return x - floorf(x);
+}
+
+static float shader_rand(float x, float y) {
+	return fract(sinf(x * 12.9898f + y * 78.233f) * 43758.5453f);
+}
+
+// meta_box.frag: warps the box towards an opening door, then jitters it by entropy
+static void apply_warp(const SoftWarp& warp, float px, float py, float& u, float& v) {
+	float scale = 7.0f;
+	u = px;
+	v = py;
+	if (warp.face == 0) {
+		float x0 = (warp.face_pos + 0.5f) / scale;
+		u = expand_parallel_axis(warp.t, py, px, x0);
+		v = expand_perpendicular_axis(warp.t, py);
+	} else if (warp.face == 1) {
+		float y0 = (6.5f - warp.face_pos) / scale;
+		v = expand_parallel_axis(warp.t, px, py, y0);
+		u = expand_perpendicular_axis(warp.t, px);
+	} else if (warp.face == 2) {
+		float x0 = (warp.face_pos - 0.5f) / scale;
+		u = expand_parallel_axis(warp.t, 1 - py, px, x0);
+		v = 1 - expand_perpendicular_axis(warp.t, 1 - py);
+	} else if (warp.face == 3) {
+		float y0 = (warp.face_pos - 0.5f) / scale;
+		v = expand_parallel_axis(warp.t, 1 - px, py, y0);
+		u = 1 - expand_perpendicular_axis(warp.t, 1 - px);
+	}
+	u += 2.0f * (shader_rand(px, py * warp.seed) - 0.5f) * .002f * warp.entropy;
+	v += 2.0f * (shader_rand(py * warp.seed, px * warp.seed) - 0.5f) * .002f * warp.entropy;
+}
+
+// meta_door.frag: fades out the door's slot of the wall, with some noise
+static bool door_wall_alpha(const SoftDoorWall& wall, float px, float py, float& alpha) {
+	float scale = 7.0f;
+	float pos_diff = 0;
+	if (wall.face == 0)      pos_diff = px * scale - wall.face_pos;
+	else if (wall.face == 1) pos_diff = py * scale - wall.face_pos;
+	else if (wall.face == 2) pos_diff = (1 - px) * scale - wall.face_pos + 1;
+	else if (wall.face == 3) pos_diff = (1 - py) * scale - wall.face_pos + 1;
+	if (!(0 < pos_diff && pos_diff < 1)) return false;
+	alpha = (pos_diff - 0.5f) * (pos_diff - 0.5f) * 10 * shader_rand(px * wall.seed, py * wall.seed) * (1 - wall.t);
+	return true;
+}
+
+SoftRaster::SoftRaster() : width(0), height(0), fragments(0) {
+}
+
+SoftRaster::SoftRaster(unsigned int width, unsigned int height) : width(0), height(0), fragments(0) {
+	create(width, height);
+}
+
+void SoftRaster::create(unsigned int _width, unsigned int _height) {
+	width = _width;
+	height = _height;
+	pixels.assign(width * height * 4, 0);
+}
+
+void SoftRaster::clear(sf::Color color) {
+	for (size_t i = 0; i < pixels.size(); i += 4) {
+		pixels[i + 0] = color.r;
+		pixels[i + 1] = color.g;
+		pixels[i + 2] = color.b;
+		pixels[i + 3] = color.a;
+	}
+}
+
+void SoftRaster::draw_quad(const SoftTexture& texture, sf::FloatRect tex_rect, const sf::Transform& transform,
+						   sf::Vector2f size, sf::Color color, const SoftWarp* warp, const SoftDoorWall* wall) {
+	if (!texture.pixels || !texture.width || !texture.height || size.x <= 0 || size.y <= 0) return;
+
+	// Bound the quad on the target
+	sf::FloatRect bounds = transform.transformRect(sf::FloatRect(0, 0, size.x, size.y));
+	int x0 = std::max(0, (int)floorf(bounds.left));
+	int y0 = std::max(0, (int)floorf(bounds.top));
+	int x1 = std::min((int)width, (int)ceilf(bounds.left + bounds.width));
+	int y1 = std::min((int)height, (int)ceilf(bounds.top + bounds.height));
+	sf::Transform inverse = transform.getInverse();
+
+	for (int y = y0; y < y1; y++)
+	for (int x = x0; x < x1; x++) {
+
+		// Map the pixel center back into the quad, in 0-1 across it
+		sf::Vector2f local = inverse.transformPoint(sf::Vector2f(x + .5f, y + .5f));
+		if (local.x < 0 || local.y < 0 || local.x >= size.x || local.y >= size.y) continue;
+		float px = local.x / size.x;
+		float py = local.y / size.y;
+		fragments++;
+
+		// Run the ported shader, and sample the texture (clamped, like the GPU)
+		float u = px, v = py;
+		if (warp) apply_warp(*warp, px, py, u, v);
+		int tx = (int)floorf(tex_rect.left + u * tex_rect.width);
+		int ty = (int)floorf(tex_rect.top + v * tex_rect.height);
+		tx = std::min(std::max(tx, 0), (int)texture.width - 1);
+		ty = std::min(std::max(ty, 0), (int)texture.height - 1);
+		const sf::Uint8* texel = texture.pixels + (ty * texture.width + tx) * 4;
+
+		float r = texel[0] * color.r / (255.f * 255.f);
+		float g = texel[1] * color.g / (255.f * 255.f);
+		float b = texel[2] * color.b / (255.f * 255.f);
+		float a = texel[3] * color.a / (255.f * 255.f);
+		float wall_alpha;
+		if (wall && door_wall_alpha(*wall, px, py, wall_alpha)) {
+			r = texel[0] / 255.f;
+			g = texel[1] / 255.f;
+			b = texel[2] / 255.f;
+			a = texel[3] / 255.f * wall_alpha;
+		}
+		a = std::min(std::max(a, 0.f), 1.f);
+
+		// Blend like sf::BlendAlpha
+		sf::Uint8* dst = &pixels[(y * width + x) * 4];
+		dst[0] = (sf::Uint8)(r * a * 255.f + dst[0] * (1 - a) + .5f);
+		dst[1] = (sf::Uint8)(g * a * 255.f + dst[1] * (1 - a) + .5f);
+		dst[2] = (sf::Uint8)(b * a * 255.f + dst[2] * (1 - a) + .5f);
+		dst[3] = (sf::Uint8)(a * 255.f + dst[3] * (1 - a) + .5f);
+	}
+}
+
+sf::Image SoftRaster::to_image() const {
+	sf::Image image;
+	if (width && height)
+		image.create(width, height, pixels.data());
+	return image;
+}
@@ -0,0 +1,77 @@
+#ifndef _SOFT_RASTER_H_
+#define _SOFT_RASTER_H_
+
+#include <vector>
+#include <SFML/Graphics.hpp>
+
+// Parameters of the meta_box shader's door warp
+struct SoftWarp {
+	float t;
+	int face;
+	int face_pos;
+	float entropy;
+	float seed;
+
+	SoftWarp() : t(0), face(0), face_pos(0), entropy(0), seed(0) {}
+};
+
+// Parameters of the meta_door shader's wall effect
+struct SoftDoorWall {
+	float t;
+	int face;
+	int face_pos;
+	float seed;
+
+	SoftDoorWall() : t(0), face(0), face_pos(0), seed(0) {}
+};
+
+// Read-only pixels to sample from, either an image or another raster
+struct SoftTexture {
+	const sf::Uint8* pixels;
+	unsigned int width, height;
+
+	SoftTexture(const sf::Image& image) :
+		pixels(image.getPixelsPtr()), width(image.getSize().x), height(image.getSize().y) {}
+	SoftTexture(const sf::Uint8* _pixels, unsigned int _width, unsigned int _height) :
+		pixels(_pixels), width(_width), height(_height) {}
+};
+
+// What rendering one box in software cost
+struct SoftCost {
+	int box_id;
+	unsigned long long fragments;	// Pixels shaded into the box's own texture
+	float seconds;					// Including its children's rendering
+};
+
+// A CPU render target covering the few operations box rendering uses:
+// alpha-blended textured quads under an affine transform, with nearest
+// sampling and the meta_box/meta_door shaders ported to C++. It needs no
+// GL context, and the same input always gives the same pixels.
+class SoftRaster {
+public:
+	SoftRaster();
+	SoftRaster(unsigned int width, unsigned int height);
+
+	void create(unsigned int width, unsigned int height);
+	void clear(sf::Color color = sf::Color::Black);
+
+	// Draws a quad of 'size' local units, mapped to the target by 'transform'
+	// and to the texture by 'tex_rect' (in texels)
+	void draw_quad(const SoftTexture& texture, sf::FloatRect tex_rect, const sf::Transform& transform,
+				   sf::Vector2f size, sf::Color color = sf::Color::White,
+				   const SoftWarp* warp = 0, const SoftDoorWall* wall = 0);
+
+	SoftTexture get_texture() const { return SoftTexture(pixels.data(), width, height); }
+	sf::Image to_image() const;
+	unsigned int get_width() const { return width; }
+	unsigned int get_height() const { return height; }
+	unsigned long long get_fragments() const { return fragments; }
+	void reset_fragments() { fragments = 0; }
+
+private:
+	std::vector<sf::Uint8> pixels;
+	unsigned int width, height;
+	unsigned long long fragments;
+};
+
+#endif
@@ -0,0 +1,147 @@
+#include "game.h"
+#include "settings.h"
+#include <SFML/System/Clock.hpp>
+
+// Software rendering mirrors render_box() on the CPU, so box output and cost
+// can be checked on machines without a GPU. Each box renders into a back
+// buffer which is then swapped in, so recursive children (which draw their
+// own box) sample the previous frame, much as they do on the GPU.
+
+void game::draw_soft() {
+	frame++;
+	boxes_rendered = 0;
+	soft_costs.clear();
+	render_box_soft(player.container->parent ? player.container->parent : player.container);
+}
+
+const SoftRaster* game::get_soft_texture(int box_id) const {
+	auto it = soft_textures.find(box_id);
+	if (it == soft_textures.end()) return 0;
+	return &it->second;
+}
+
+void game::render_box_soft(shared_ptr<Box> box) {
+
+	// Only unique, non-recursive boxes have their own texture
+	if (box->recursive || box->prototype) return;
+	if (box->rendered_frame == frame) return;
+	box->rendered_frame = frame;
+	boxes_rendered++;
+	sf::Clock clock;
+
+	SoftRaster& target = soft_back_textures[box->id];
+	if (target.get_width() != BOX_RENDER_SIZE)
+		target.create(BOX_RENDER_SIZE, BOX_RENDER_SIZE);
+	target.clear();
+	target.reset_fragments();
+	SoftTexture sprites(atlas.get_image());
+
+	// Draw the bg texture
+	target.draw_quad(sprites, sf::FloatRect(box->bg), sf::Transform(),
+		sf::Vector2f(BOX_RENDER_SIZE, BOX_RENDER_SIZE));
+
+	// If the player is in this box, render him
+	if (player.container == box) {
+		sf::IntRect rect = atlas.get_rect("player");
+		auto player_physical_position = player.body->GetPosition();
+		sf::Transform transform;
+		transform.translate(player_physical_position.x * PIXELS_PER_METER, player_physical_position.y * PIXELS_PER_METER)
+				 .scale(.5f, .5f)
+				 .translate(rect.width * -.5f, rect.height * -.5f);
+		target.draw_quad(sprites, sf::FloatRect(rect), transform, sf::Vector2f(rect.width, rect.height));
+	}
+
+	// Render and draw non-recursive children
+	render_children_soft(box, target, false);
+
+	// Draw blocks, cut up the same way as render_box()'s
+	sf::IntRect block_rect = atlas.get_rect("block");
+	for (int sx = 0; sx < BOX_SLOTS; sx++)
+	for (int sy = 0; sy < BOX_SLOTS; sy++) {
+		if (box->blocks[sx][sy] == 1) {
+			sf::FloatRect rects[4], tex_rects[4];
+			int quads = get_block_quads(sx, sy, block_rect, rects, tex_rects);
+			for (int i = 0; i < quads; i++)
+				target.draw_quad(sprites, tex_rects[i],
+					sf::Transform().translate(rects[i].left, rects[i].top),
+					sf::Vector2f(rects[i].width, rects[i].height));
+		}
+	}
+
+	// Draw walls over the blocks in face order, as render_box() does, with the
+	// door effect where there is one
+	float thickness = 6.f;
+	float side = (float)BOX_SLOTS * (float)BOX_PIXELS_PER_SLOT;
+	for (int face = 0; face < 4; face++) {
+		sf::FloatRect wall_rect;
+		if ((BoxFace)face == Top) wall_rect = sf::FloatRect(0, 0, side, thickness);
+		else if ((BoxFace)face == Right) wall_rect = sf::FloatRect(side - thickness, 0, thickness, side);
+		else if ((BoxFace)face == Bottom) wall_rect = sf::FloatRect(0, side - thickness, side, thickness);
+		else wall_rect = sf::FloatRect(0, 0, thickness, side);
+
+		SoftDoorWall wall;
+		auto door = box->doors[face];
+		if (door) {
+			wall.t = door->adjacency ? 1.f : door->t;
+			wall.face = face;
+			if (face == BoxFace::Top) wall.face_pos = door->slot->x;
+			else if (face == BoxFace::Right) wall.face_pos = door->slot->y;
+			else if (face == BoxFace::Bottom) wall.face_pos = BOX_SLOTS - door->slot->x;
+			else if (face == BoxFace::Left) wall.face_pos = BOX_SLOTS - door->slot->y;
+		}
+		target.draw_quad(sprites, sf::FloatRect(block_rect),
+			sf::Transform().translate(wall_rect.left, wall_rect.top),
+			sf::Vector2f(wall_rect.width, wall_rect.height),
+			sf::Color::White, 0, door ? &wall : 0);
+	}
+
+	// Draw all recursive children
+	render_children_soft(box, target, true);
+
+	// Record this box's own cost. Fragments don't include the children's
+	// own rendering, but the time does.
+	SoftCost cost;
+	cost.box_id = box->id;
+	cost.fragments = target.get_fragments();
+	cost.seconds = clock.getElapsedTime().asSeconds();
+	soft_costs.push_back(cost);
+
+	std::swap(soft_textures[box->id], target);
+}
+
+void game::render_children_soft(shared_ptr<Box> parent, SoftRaster& target, bool recursive) {
+	SoftTexture sprites(atlas.get_image());
+	for (auto child : parent->children) {
+		if (child->recursive != recursive) continue;
+
+		// Get the child's texture
+		shared_ptr<Box> source = child->recursive ? parent : child->prototype ? child->prototype : child;
+		if (source != parent) render_box_soft(source);
+		auto texture = get_soft_texture(source->id);
+		if (!texture) continue;
+
+		// Calculate the child transform, centered like append_box_quad's quads
+		auto child_physical_pos = child->body->GetPosition();
+		auto child_physical_ang = child->body->GetAngle();
+		sf::Transform transform;
+		transform.translate(child_physical_pos.x * PIXELS_PER_METER, child_physical_pos.y * PIXELS_PER_METER)
+				 .rotate(child_physical_ang * 180.f / 3.14159f)
+				 .scale(1.f / (float)BOX_SLOTS, 1.f / (float)BOX_SLOTS);
+
+		// The door warp, with a fixed seed so the output is repeatable
+		SoftWarp warp;
+		warp.entropy = (float)player.recursions.size();
+		get_box_door_transition(child, warp.t, warp.face, warp.face_pos);
+		warp.t = std::min(warp.t, 1.f);
+
+		float size = (float)BOX_RENDER_SIZE;
+		target.draw_quad(texture->get_texture(), sf::FloatRect(0, 0, size, size),
+			sf::Transform(transform).translate(size * -.5f, size * -.5f),
+			sf::Vector2f(size, size), sf::Color::White, &warp);
+
+		// Draw the child's fg, stretched over the whole child
+		target.draw_quad(sprites, sf::FloatRect(parent->fg),
+			sf::Transform(transform).translate(size * -.5f, size * -.5f),
+			sf::Vector2f(size, size));
+	}
+}
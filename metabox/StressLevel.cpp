@@ -0,0 +1,59 @@
+#include "game.h"
+#include "settings.h"
+#include <functional>
+#include <random>
+
+void game::generate_stress_level(const StressParams& params) {
+	std::mt19937 rng(params.seed);
+	std::uniform_real_distribution<float> chance(0.f, 1.f);
+	std::uniform_int_distribution<int> door_index(0, BOX_SLOTS - 1);
+
+	// A detached box built for each depth, for the children there to instance
+	vector<shared_ptr<Box>> depth_prototypes(params.depth + 1);
+
+	// Builds one box and, depth permitting, its subtree
+	std::function<void(shared_ptr<Box>, int)> fill = [&](shared_ptr<Box> box, int depth) {
+
+		// Doors go on first so that recursive children pick them up
+		for (int face = 0; face < 4; face++)
+			if (chance(rng) < params.door_density)
+				set_box_door(box, (BoxFace)face, door_index(rng));
+
+		// Shuffle the free slots. The player's starting slot in the root stays clear.
+		vector<int> free_slots;
+		for (int i = 0; i < BOX_SLOTS * BOX_SLOTS; i++)
+			if (box != root_box || i != 4 * BOX_SLOTS + 3)
+				free_slots.push_back(i);
+		std::shuffle(free_slots.begin(), free_slots.end(), rng);
+
+		// Place the children into the first free slots
+		int child_count = depth < params.depth ? std::min(params.breadth, (int)free_slots.size()) : 0;
+		for (int i = 0; i < child_count; i++) {
+			int sx = free_slots[i] / BOX_SLOTS;
+			int sy = free_slots[i] % BOX_SLOTS;
+			auto& prototype = depth_prototypes[depth + 1];
+			if (chance(rng) < params.recursion) {
+				add_box(box, sx, sy, true);
+			} else if (prototype && chance(rng) < params.instancing) {
+				add_box_instance(box, sx, sy, prototype);
+			} else if (!prototype && params.instancing > 0) {
+
+				// The first full box at each depth is built detached and shown through an
+				// instance like the rest, so entering or editing any of them copies on write
+				prototype = add_prototype();
+				fill(prototype, depth + 1);
+				add_box_instance(box, sx, sy, prototype);
+			} else {
+				fill(add_box(box, sx, sy), depth + 1);
+			}
+		}
+
+		// Scatter blocks through the rest
+		for (int i = child_count; i < (int)free_slots.size(); i++)
+			if (chance(rng) < params.block_density)
+				add_block(box, free_slots[i] / BOX_SLOTS, free_slots[i] % BOX_SLOTS);
+	};
+
+	root_box = add_box();
+	fill(root_box, 0);
+}
@@ -0,0 +1,18 @@
+#ifndef _STRESS_LEVEL_H_
+#define _STRESS_LEVEL_H_
+
+// Shape of a procedurally generated level, used to see how the engine
+// scales as the box tree grows.
+struct StressParams {
+	int breadth;			// child boxes per box
+	int depth;				// levels of nesting below the root
+	float door_density;		// chance of a door on each face of each box
+	float block_density;	// chance of a block in each remaining free slot
+	float recursion;		// chance that a child is a recursive box
+	float instancing;		// chance that a child is an instance of an earlier box at its depth
+	unsigned int seed;
+
+	StressParams() : breadth(3), depth(2), door_density(.5f), block_density(.1f), recursion(.1f), instancing(0), seed(1) {}
+};
+
+#endif
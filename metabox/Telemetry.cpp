@@ -0,0 +1,126 @@
+#include "Telemetry.h"
+#include <chrono>
+
+Telemetry::Telemetry() : file(0), json(false), closing(false) {
+}
+
+Telemetry::~Telemetry() {
+	close();
+}
+
+bool Telemetry::open(const string& path) {
+	close();
+	file = fopen(path.c_str(), "w");
+	if (!file) return false;
+
+	// The extension picks the format
+	json = path.size() >= 6 && path.compare(path.size() - 6, 6, ".jsonl") == 0;
+	if (!json)
+		fprintf(file, "kind,frame,step,time,draw_time,worlds,world_step,collide,solve,solve_toi,broadphase,"
+			"bodies,contacts,proxies,boxes_rendered,draw_calls,texture_binds,memory\n");
+
+	closing = false;
+	thread = std::thread(&Telemetry::run, this);
+	return true;
+}
+
+void Telemetry::close() {
+	if (!file) return;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		closing = true;
+	}
+	wake.notify_one();
+	thread.join();
+	fclose(file);
+	file = 0;
+}
+
+void Telemetry::write(TelemetryRecord&& record) {
+	if (!file) return;
+	bool flush;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		pending.push_back(std::move(record));
+		flush = pending.size() >= TELEMETRY_FLUSH_RECORDS;
+	}
+	if (flush)
+		wake.notify_one();
+}
+
+void Telemetry::run() {
+	vector<TelemetryRecord> batch;
+	string out;
+	bool done = false;
+	while (!done) {
+
+		// Take everything queued so far, and let the game carry on queueing
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait_for(lock, std::chrono::seconds(TELEMETRY_FLUSH_SECONDS), [this] {
+				return closing || pending.size() >= TELEMETRY_FLUSH_RECORDS;
+			});
+			batch.swap(pending);
+			done = closing;
+		}
+
+		out.clear();
+		for (auto& record : batch) {
+			if (json) format_json(record, out);
+			else format_csv(record, out);
+		}
+		batch.clear();
+		if (!out.empty()) {
+			fwrite(out.data(), 1, out.size(), file);
+			fflush(file);
+		}
+	}
+}
+
+void Telemetry::format_csv(const TelemetryRecord& record, string& out) {
+	TelemetryWorld total = {};
+	for (auto& world : record.worlds) {
+		total.step += world.step;
+		total.collide += world.collide;
+		total.solve += world.solve;
+		total.solve_toi += world.solve_toi;
+		total.broadphase += world.broadphase;
+		total.bodies += world.bodies;
+		total.contacts += world.contacts;
+		total.proxies += world.proxies;
+	}
+
+	char line[512];
+	snprintf(line, sizeof(line), "%s,%d,%d,%.6f,%.6f,%d,%.4f,%.4f,%.4f,%.4f,%.4f,%d,%d,%d,%d,%d,%d,%zu\n",
+		record.kind == TelemetryRecord::Step ? "step" : "frame", record.frame, record.step,
+		record.time, record.draw_time, (int)record.worlds.size(),
+		total.step, total.collide, total.solve, total.solve_toi, total.broadphase,
+		total.bodies, total.contacts, total.proxies,
+		record.boxes_rendered, record.draw_calls, record.texture_binds, record.memory);
+	out += line;
+}
+
+void Telemetry::format_json(const TelemetryRecord& record, string& out) {
+	char buffer[512];
+	if (record.kind == TelemetryRecord::Step) {
+		snprintf(buffer, sizeof(buffer), "{\"kind\":\"step\",\"frame\":%d,\"step\":%d,\"time\":%.6f,\"worlds\":[",
+			record.frame, record.step, record.time);
+		out += buffer;
+		bool first = true;
+		for (auto& world : record.worlds) {
+			snprintf(buffer, sizeof(buffer), "%s{\"box\":%d,\"step\":%.4f,\"collide\":%.4f,\"solve\":%.4f,"
+				"\"solve_toi\":%.4f,\"broadphase\":%.4f,\"bodies\":%d,\"contacts\":%d,\"proxies\":%d}",
+				first ? "" : ",", world.box_id, world.step, world.collide, world.solve,
+				world.solve_toi, world.broadphase, world.bodies, world.contacts, world.proxies);
+			out += buffer;
+			first = false;
+		}
+		out += "]}\n";
+	} else {
+		snprintf(buffer, sizeof(buffer), "{\"kind\":\"frame\",\"frame\":%d,\"step\":%d,\"time\":%.6f,\"draw_time\":%.6f,"
+			"\"boxes_rendered\":%d,\"draw_calls\":%d,\"texture_binds\":%d,\"memory\":%zu}\n",
+			record.frame, record.step, record.time, record.draw_time,
+			record.boxes_rendered, record.draw_calls, record.texture_binds, record.memory);
+		out += buffer;
+	}
+}
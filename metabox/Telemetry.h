@@ -0,0 +1,66 @@
+#ifndef _TELEMETRY_H_
+#define _TELEMETRY_H_
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+using std::string;
+using std::vector;
+
+#define TELEMETRY_FLUSH_RECORDS 256	// records queued before the writer is woken early
+#define TELEMETRY_FLUSH_SECONDS 1
+#define TELEMETRY_MEMORY_FRAMES 60	// frames between walks of the box tree for its memory
+
+// One box world's share of a step, from its b2Profile (milliseconds) and counts
+struct TelemetryWorld {
+	int box_id;
+	float step, collide, solve, solve_toi, broadphase;
+	int bodies, contacts, proxies;
+};
+
+// A step record has the physics filled in; a frame record has the rendering
+struct TelemetryRecord {
+	enum Kind { Step, Frame } kind;
+	int frame = 0;
+	int step = 0;
+	float time = 0;			// seconds spent in the step, or since the last frame
+	float draw_time = 0;
+	int boxes_rendered = 0;
+	int draw_calls = 0;
+	int texture_binds = 0;
+	size_t memory = 0;		// bytes held by the box tree, as last sampled
+	vector<TelemetryWorld> worlds;
+};
+
+// Streams records to a .csv or .jsonl file. Records are only queued on the
+// game thread; a background thread formats and writes them in batches, so a
+// slow disk never stalls a frame. CSV rows total the worlds of a step, while
+// JSON Lines keeps each world separately.
+class Telemetry {
+public:
+	Telemetry();
+	~Telemetry();
+
+	bool open(const string& path);
+	void close();
+	bool is_open() const { return file != 0; }
+	void write(TelemetryRecord&& record);
+
+private:
+	void run();
+	void format_csv(const TelemetryRecord& record, string& out);
+	void format_json(const TelemetryRecord& record, string& out);
+
+	FILE* file;
+	bool json;
+	bool closing;
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable wake;
+	vector<TelemetryRecord> pending;
+};
+
+#endif
@@ -0,0 +1,65 @@
+#include "TextBatch.h"
+
+TextBatch::TextBatch() : font(0) {
+}
+
+void TextBatch::clear() {
+	for (auto& batch : batches)
+		batch.second.clear();
+}
+
+void TextBatch::add(const string& text, sf::Vector2f position, unsigned int size, sf::Color color) {
+	if (!font) return;
+	auto& verts = batches[size];
+	verts.setPrimitiveType(sf::PrimitiveType::Quads);
+
+	// Lay the glyphs out the way sf::Text does, from the top of the first line
+	float whitespace = font->getGlyph(L' ', size, false).advance;
+	float line_spacing = font->getLineSpacing(size);
+	float x = 0;
+	float y = (float)size;
+	sf::Uint32 prev = 0;
+	for (unsigned char c : text) {
+		if (c == '\r') continue;
+		x += font->getKerning(prev, c, size);
+		prev = c;
+
+		if (c == ' ') { x += whitespace; continue; }
+		if (c == '\t') { x += whitespace * 4; continue; }
+		if (c == '\n') { x = 0; y += line_spacing; continue; }
+
+		// Add the glyph's quad, padded by a texel like sf::Text
+		const sf::Glyph& glyph = font->getGlyph(c, size, false);
+		float padding = 1;
+		sf::Vector2f pos = position + sf::Vector2f(x, y);
+		float left = pos.x + glyph.bounds.left - padding;
+		float top = pos.y + glyph.bounds.top - padding;
+		float right = pos.x + glyph.bounds.left + glyph.bounds.width + padding;
+		float bottom = pos.y + glyph.bounds.top + glyph.bounds.height + padding;
+		float u1 = glyph.textureRect.left - padding;
+		float v1 = glyph.textureRect.top - padding;
+		float u2 = glyph.textureRect.left + glyph.textureRect.width + padding;
+		float v2 = glyph.textureRect.top + glyph.textureRect.height + padding;
+		verts.append(sf::Vertex(sf::Vector2f(left, top), color, sf::Vector2f(u1, v1)));
+		verts.append(sf::Vertex(sf::Vector2f(right, top), color, sf::Vector2f(u2, v1)));
+		verts.append(sf::Vertex(sf::Vector2f(right, bottom), color, sf::Vector2f(u2, v2)));
+		verts.append(sf::Vertex(sf::Vector2f(left, bottom), color, sf::Vector2f(u1, v2)));
+
+		x += glyph.advance;
+	}
+}
+
+void TextBatch::add_shadowed(const string& text, sf::Vector2f position, unsigned int size, sf::Color color, sf::Color shadow) {
+	add(text, position + sf::Vector2f(1, 1), size, shadow);
+	add(text, position, size, color);
+}
+
+void TextBatch::draw(sf::RenderTarget& target, DrawStats* stats) {
+	if (!font) return;
+	for (auto& batch : batches) {
+		if (!batch.second.getVertexCount()) continue;
+		if (stats)
+			stats->count(&target, &font->getTexture(batch.first));
+		target.draw(batch.second, sf::RenderStates(&font->getTexture(batch.first)));
+	}
+}
@@ -0,0 +1,32 @@
+#ifndef _TEXT_BATCH_H_
+#define _TEXT_BATCH_H_
+
+#include <map>
+#include <string>
+#include <SFML/Graphics.hpp>
+#include "DrawStats.h"
+
+using std::map;
+using std::string;
+
+// Collects the glyph quads of many strings against the font's page textures,
+// so all of a frame's labels draw in one call per character size instead of
+// one sf::Text (and one draw) each. The vertex arrays are kept between frames
+// so their storage is reused.
+class TextBatch {
+public:
+	TextBatch();
+
+	void set_font(const sf::Font* _font) { font = _font; }
+	void clear();
+	void add(const string& text, sf::Vector2f position, unsigned int size, sf::Color color);
+	void add_shadowed(const string& text, sf::Vector2f position, unsigned int size, sf::Color color,
+					  sf::Color shadow = sf::Color::Black);
+	void draw(sf::RenderTarget& target, DrawStats* stats = 0);
+
+private:
+	const sf::Font* font;
+	map<unsigned int, sf::VertexArray> batches;	// by character size, as each has its own page
+};
+
+#endif
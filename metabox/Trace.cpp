@@ -0,0 +1,108 @@
+#include "Trace.h"
+#include <chrono>
+#include <mutex>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+using std::vector;
+
+namespace {
+	const auto trace_epoch = std::chrono::steady_clock::now();
+	std::atomic<bool> trace_enabled(true);
+
+	// Rings are registered once per thread and live until exit, so that
+	// spans from threads which have already finished can still be dumped.
+	std::mutex rings_mutex;
+	vector<TraceRing*> rings;
+
+	TraceRing* get_thread_ring() {
+		thread_local TraceRing* ring = 0;
+		if (!ring) {
+			ring = new TraceRing();
+			ring->head = 0;
+			std::lock_guard<std::mutex> lock(rings_mutex);
+			ring->thread_id = (int)rings.size() + 1;
+			rings.push_back(ring);
+		}
+		return ring;
+	}
+
+	void write_json_string(FILE* file, const char* str) {
+		fputc('"', file);
+		for (; *str; str++) {
+			if (*str == '"' || *str == '\\') fputc('\\', file);
+			if ((unsigned char)*str >= 0x20) fputc(*str, file);
+		}
+		fputc('"', file);
+	}
+}
+
+long long trace_now() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - trace_epoch).count();
+}
+
+void trace_enable(bool enabled) {
+	trace_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+bool trace_is_enabled() {
+	return trace_enabled.load(std::memory_order_relaxed);
+}
+
+void trace_record(const char* name, long long start, long long duration, int id) {
+	if (!trace_is_enabled()) return;
+	auto ring = get_thread_ring();
+	auto head = ring->head.load(std::memory_order_relaxed);
+	auto& event = ring->events[head % TRACE_RING_SIZE];
+	strncpy(event.name, name, TRACE_NAME_SIZE - 1);
+	event.name[TRACE_NAME_SIZE - 1] = 0;
+	event.id = id;
+	event.start = start;
+	event.duration = duration;
+	ring->head.store(head + 1, std::memory_order_release);
+}
+
+bool trace_dump(const string& path) {
+	FILE* file = fopen(path.c_str(), "w");
+	if (!file) return false;
+
+	// Snapshot the current set of rings
+	vector<TraceRing*> snapshot;
+	{
+		std::lock_guard<std::mutex> lock(rings_mutex);
+		snapshot = rings;
+	}
+
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+	bool first = true;
+	for (auto ring : snapshot) {
+
+		// Copy out the newest window of events. Anything the writer may have
+		// lapped while we were copying is dropped rather than emitted torn.
+		auto head = ring->head.load(std::memory_order_acquire);
+		auto begin = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+		vector<TraceEvent> events;
+		events.reserve((size_t)(head - begin));
+		for (auto i = begin; i < head; i++)
+			events.push_back(ring->events[i % TRACE_RING_SIZE]);
+		// A full ring's oldest slot is also the one the writer fills next.
+		auto lapped = ring->head.load(std::memory_order_acquire) - head + (begin > 0 ? 1 : 0);
+		size_t skip = (size_t)(lapped < events.size() ? lapped : events.size());
+
+		for (size_t i = skip; i < events.size(); i++) {
+			auto& event = events[i];
+			fprintf(file, "%s\n{\"name\":", first ? "" : ",");
+			write_json_string(file, event.name);
+			fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%lld,\"dur\":%lld",
+				ring->thread_id, event.start, event.duration);
+			if (event.id >= 0)
+				fprintf(file, ",\"args\":{\"id\":%d}", event.id);
+			fputc('}', file);
+			first = false;
+		}
+	}
+	fprintf(file, "\n]}\n");
+	fclose(file);
+	return true;
+}
@@ -0,0 +1,48 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <atomic>
+#include <string>
+using std::string;
+
+#define TRACE_RING_SIZE 65536 // events per thread
+#define TRACE_NAME_SIZE 48
+
+// A single completed span, in microseconds since the trace epoch
+struct TraceEvent {
+	char name[TRACE_NAME_SIZE];
+	int id;	// of the box the span was for, or -1
+	long long start;
+	long long duration;
+};
+
+// Each thread writes into its own ring, so recording never takes a lock.
+// Only the owning thread advances head; readers copy behind it.
+struct TraceRing {
+	TraceEvent events[TRACE_RING_SIZE];
+	std::atomic<unsigned long long> head;
+	int thread_id;
+};
+
+long long trace_now();
+void trace_record(const char* name, long long start, long long duration, int id = -1);
+bool trace_dump(const string& path);
+
+// Recording is on unless turned off, so a dump has the recent frames to show
+void trace_enable(bool enabled);
+bool trace_is_enabled();
+
+// Records the enclosing scope as a trace span. The name isn't copied until
+// the span is recorded, so it has to outlive the scope.
+class TraceScope {
+public:
+	TraceScope(const char* _name, int _id = -1) : name(_name), id(_id), start(trace_is_enabled() ? trace_now() : -1) {}
+	~TraceScope() { if (start >= 0) trace_record(name, start, trace_now() - start, id); }
+
+private:
+	const char* name;
+	int id;
+	long long start;
+};
+
+#endif
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <SFML/Graphics/Transform.hpp>
+#include <math.h>
+
+// An affine 2d transform kept in double precision. Nesting levels scale by
+// BOX_SLOTS each, so the view transform is composed in doubles relative to
+// the camera and only converted to a float sf::Transform at the very end.
+struct Transform2d {
+
+	// Members (x' = a*x + c*y + tx, y' = b*x + d*y + ty)
+	double a, b, c, d, tx, ty;
+
+	// 'Tors
+	Transform2d() : a(1), b(0), c(0), d(1), tx(0), ty(0) {}
+
+	// Methods, each post-multiplying like sf::Transform's
+	Transform2d& translate(double x, double y) {
+		tx += a * x + c * y;
+		ty += b * x + d * y;
+		return *this;
+	}
+
+	Transform2d& scale(double sx, double sy) {
+		a *= sx; b *= sx;
+		c *= sy; d *= sy;
+		return *this;
+	}
+
+	Transform2d& rotate(double degrees) {
+		double rad = degrees * 3.141592653589793 / 180.0;
+		double cos_r = cos(rad), sin_r = sin(rad);
+		double a0 = a, b0 = b;
+		a = a0 * cos_r + c * sin_r;
+		b = b0 * cos_r + d * sin_r;
+		c = c * cos_r - a0 * sin_r;
+		d = d * cos_r - b0 * sin_r;
+		return *this;
+	}
+
+	// Conversions
+	sf::Transform toTransform() const {
+		return sf::Transform(
+			(float)a, (float)c, (float)tx,
+			(float)b, (float)d, (float)ty,
+			0.f, 0.f, 1.f);
+	}
+};
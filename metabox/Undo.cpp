@@ -0,0 +1,287 @@
+#include "game.h"
+#include "settings.h"
+#include <functional>
+
+// Editor commands are journaled as small reversible ops (see Journal.h).
+// Undo reverts the newest op and redo re-applies it, each only touching what
+// that one op changed.
+
+void game::undo() {
+	auto op = journal.peek_undo();
+	if (!op || !apply_journal_op(*op, false)) return;
+	journal.pop_undo();
+}
+
+void game::redo() {
+	auto op = journal.peek_redo();
+	if (!op || !apply_journal_op(*op, true)) return;
+	journal.pop_redo();
+}
+
+bool game::apply_journal_op(const JournalOp& op, bool forward) {
+
+	// Nothing done while replaying is itself journaled
+	JournalScope journal_scope(journal);
+
+	// An edit which made an instance unique takes back the contents it made, so
+	// the instance follows its prototype again. The player can't be left inside.
+	if (op.unique && !forward && holds_player(op.unique)) return false;
+	if (op.unique && forward) unshare_box_contents(op.unique, op.unique_contents);
+
+	auto box = op.box;
+	bool applied = false;
+	switch (op.type) {
+	case OpAddBox:
+		applied = forward ? attach_box(box) : detach_box(box);
+		break;
+
+	case OpMoveBox:
+		if (!box->parent) return false;
+		if (forward) set_box_target(box, op.to_sx, op.to_sy);
+		else set_box_target(box, op.sx, op.sy);
+		applied = true;
+		break;
+
+	case OpSetDoor:
+		restore_box_door(box, (BoxFace)op.face, forward ? op.door_after : op.door_before);
+		applied = true;
+		break;
+
+	case OpOpenDoor:
+		set_box_doors_open(box, forward ? op.open_after : op.open_before);
+		applied = true;
+		break;
+
+	case OpAddBlock:
+		if (forward) add_block(box, op.sx, op.sy);
+		else remove_block(box, op.sx, op.sy);
+		applied = true;
+		break;
+
+	case OpPushBoxes:
+		// Each chain moved front first, so undoing walks back from the rear
+		if (forward)
+			for (auto& move : op.moves)
+				apply_journal_op(move, true);
+		else
+			for (auto it = op.moves.rbegin(); it != op.moves.rend(); ++it)
+				apply_journal_op(*it, false);
+		applied = true;
+		break;
+	}
+
+	if (op.unique && !forward && applied)
+		share_box_contents(op.unique, op.prototype, op.unique_contents);
+	return applied;
+}
+
+static void collect_subtree(shared_ptr<Box> box, vector<shared_ptr<Box>>& subtree) {
+	subtree.push_back(box);
+	for (auto child : box->children)
+		collect_subtree(child, subtree);
+}
+
+bool game::holds_player(shared_ptr<Box> box) {
+	vector<shared_ptr<Box>> subtree;
+	collect_subtree(box, subtree);
+	for (auto b : subtree)
+		if (b == player.container) return true;
+	return false;
+}
+
+bool game::detach_box(shared_ptr<Box> box) {
+	auto parent = box->parent;
+	if (!parent || !box->body) return false;
+
+	// The player can't be left inside a box that's going away
+	if (holds_player(box)) return false;
+	vector<shared_ptr<Box>> subtree;
+	collect_subtree(box, subtree);
+
+	// Break any door adjacencies into the box
+	for (auto door : box->doors) {
+		if (door && door->adjacency) {
+			if (door->adjacency->adjacency == door)
+				door->adjacency->adjacency = 0;
+			door->adjacency = 0;
+		}
+		if (door && door == nearest_door)
+			nearest_door = 0;
+	}
+
+	// Take the box out of its parent's slots, children and world. The box keeps
+	// its own world and contents, so it can be attached again as it was.
+	if (box->slot && box->slot->child == box)
+		box->slot->child = 0;
+	box->slot = 0;
+	auto& claim = parent->slots[box->target_sx][box->target_sy].claim;
+	if (claim == box)
+		claim = 0;
+	parent->children.remove(box);
+	parent->world->DestroyBody(box->body);
+	portal_listener.forget(box.get());
+	box->body = 0;
+	for (int i = 0; i < 4; i++)
+		box->body_edges[i] = 0;
+
+	// Drop the whole subtree from the game, giving back its textures
+	for (auto b : subtree) {
+		boxes.remove(b);
+		if (b->active) {
+			active_boxes.remove(b);
+			b->active = false;
+		}
+		if (b->texture)
+			release_box_texture(b);
+	}
+
+	parent->door_index.dirty = true;
+	invalidate_box_nav(parent);
+	touch_box(parent);
+	tree_revision++;
+	return true;
+}
+
+bool game::attach_box(shared_ptr<Box> box) {
+	auto parent = box->parent;
+	if (!parent || box->body || !parent->world) return false;
+
+	// Put the subtree back into the game, with textures for the boxes that had them
+	vector<shared_ptr<Box>> subtree;
+	collect_subtree(box, subtree);
+	for (auto b : subtree) {
+		boxes.push_back(b);
+		if (!b->recursive && !b->prototype)
+			assign_box_texture(b);
+	}
+
+	// Put the box back into its parent, at the slot it was headed for
+	box->sx = box->target_sx;
+	box->sy = box->target_sy;
+	parent->children.push_back(box);
+	parent->slots[box->sx][box->sy].claim = box;
+	add_box_hull(box, parent->world, (float)BOX_PHYSICAL_SIZE / (float)BOX_SLOTS, box->sx, box->sy);
+
+	parent->door_index.dirty = true;
+	invalidate_box_nav(parent);
+	touch_box(parent);
+	tree_revision++;
+	activate_box(box);
+	return true;
+}
+
+// Swaps a box's own world, blocks and children with the ones held in contents
+static void swap_box_contents(Box& box, Box& contents) {
+	std::swap(box.world, contents.world);
+	std::swap(box.world_edges, contents.world_edges);
+	std::swap(box.children, contents.children);
+	std::swap(box.blocks, contents.blocks);
+	std::swap(box.block_bodies, contents.block_bodies);
+	for (int sx = 0; sx < BOX_SLOTS; sx++)
+	for (int sy = 0; sy < BOX_SLOTS; sy++) {
+		std::swap(box.slots[sx][sy].child, contents.slots[sx][sy].child);
+		std::swap(box.slots[sx][sy].claim, contents.slots[sx][sy].claim);
+	}
+}
+
+void game::share_box_contents(shared_ptr<Box> box, shared_ptr<Box> prototype, shared_ptr<Box> contents) {
+
+	// The box's children leave the game, still in its world, until it's made unique again
+	for (auto child : box->children) {
+		vector<shared_ptr<Box>> subtree;
+		collect_subtree(child, subtree);
+		for (auto b : subtree) {
+			boxes.remove(b);
+			if (b->active) {
+				active_boxes.remove(b);
+				b->active = false;
+			}
+			if (b->texture)
+				release_box_texture(b);
+			if (b == editor_selection)
+				editor_selection = 0;
+			if (nearest_door && nearest_door->box == b)
+				nearest_door = 0;
+		}
+	}
+	if (box->texture)
+		release_box_texture(box);
+	swap_box_contents(*box, *contents);
+	box->prototype = prototype;
+
+	box->door_index.dirty = true;
+	if (box->parent)
+		box->parent->door_index.dirty = true;
+	invalidate_box_nav(box);
+	touch_box(box);
+	tree_revision++;
+}
+
+void game::unshare_box_contents(shared_ptr<Box> box, shared_ptr<Box> contents) {
+	if (!box->prototype) return;
+	box->prototype = 0;
+	swap_box_contents(*box, *contents);
+	assign_box_texture(box);
+	for (auto child : box->children) {
+		vector<shared_ptr<Box>> subtree;
+		collect_subtree(child, subtree);
+		for (auto b : subtree) {
+			boxes.push_back(b);
+			if (!b->recursive && !b->prototype)
+				assign_box_texture(b);
+		}
+		activate_box(child);
+	}
+
+	box->door_index.dirty = true;
+	if (box->parent)
+		box->parent->door_index.dirty = true;
+	invalidate_box_nav(box);
+	touch_box(box);
+	tree_revision++;
+}
+
+void game::restore_box_door(shared_ptr<Box> box, BoxFace face, shared_ptr<BoxDoor> door) {
+
+	// Unpair the door being replaced, so its neighbour doesn't keep pointing at it
+	auto replaced = box->doors[(int)face];
+	if (replaced && replaced != door && replaced->adjacency) {
+		if (replaced->adjacency->adjacency == replaced)
+			replaced->adjacency->adjacency = 0;
+		replaced->adjacency = 0;
+	}
+
+	box->doors[(int)face] = door;
+	box->door_index.dirty = true;
+	if (box->parent)
+		box->parent->door_index.dirty = true;
+	invalidate_box_nav(box);
+	generate_box_edges(box);
+	generate_world_edges(box);
+
+	// Pair the restored door, and the neighbour's facing door, which may now have no partner.
+	// A box still being placed gets its pairs once update_boxes() puts it in a slot.
+	if (box->slot) {
+		find_door_adjacencies(box);
+		Slot* adjacent_slot = get_adjacent_slot(box->slot, face);
+		if (adjacent_slot && adjacent_slot->child && adjacent_slot->child != box)
+			find_door_adjacencies(adjacent_slot->child);
+	}
+	activate_box(box);
+}
+
+void game::set_box_doors_open(shared_ptr<Box> box, const bool open[4]) {
+	for (int i = 0; i < 4; i++)
+		if (box->doors[i])
+			box->doors[i]->open = open[i];
+	activate_box(box);
+	pathfinder.invalidate_routes();
+
+	generate_box_edges(box);
+	generate_world_edges(box);
+
+	// Recursive children mirror their parent's doors
+	for (auto child : box->children)
+		if (child->recursive)
+			set_box_doors_open(child, open);
+}
@@ -1,10 +1,11 @@
 #pragma once
 
+// Camera parameters, in double precision since they span several nesting levels
 struct View {
-	float x, tx;
-	float y, ty;
-	float scale, tscale;
-	float angle, tangle;
+	double x, tx;
+	double y, ty;
+	double scale, tscale;
+	double angle, tangle;
 
 	View() : x(0), tx(0), y(0), ty(0), scale(1), tscale(1), angle(0), tangle(0) {}
 };
\ No newline at end of file
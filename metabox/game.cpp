@@ -3,9 +3,12 @@
 #include "vec2f.h"
 #include <SFML/OpenGL.hpp>
 #include <SFML/System/Clock.hpp>
+#include <stdio.h>
 
 void game::setup() {
 	next_box_id = 0;
+	perf.load(perf_path);
+	queue_assets();
 
 	// Set up boxes
 	auto a = add_box();
@@ -30,78 +33,222 @@ void game::setup() {
 	for (int i = 0; i < 7; i++)
 		add_block(a, i, 6);
 
+	setup_world();
+	load_atlas();
+	setup_graphics(false);
+	apply_perf_profile();
+
+	//
+	//set_mode(Edit);
+}
+
+void game::setup(const StressParams& params, bool headless, bool software) {
+	next_box_id = 0;
+	this->software = software;
+	perf.load(perf_path);
+
+	// Build a generated level in place of the hand-made one
+	queue_assets();
+	generate_stress_level(params);
+
+	setup_world();
+	load_atlas();
+	if (!software)
+		setup_graphics(headless);
+	apply_perf_profile();
+}
+
+void game::record_frame_telemetry(float draw_time) {
+	if (!telemetry.is_open()) return;
+	TelemetryRecord record;
+	record.kind = TelemetryRecord::Frame;
+	record.frame = frame;
+	record.step = step_count;
+	record.time = telemetry_clock.restart().asSeconds();
+	record.draw_time = draw_time;
+	record.boxes_rendered = boxes_rendered;
+	record.draw_calls = draw_stats.draw_calls;
+	record.texture_binds = draw_stats.texture_binds;
+
+	// Measuring the memory walks the whole tree, so it's only sampled now and then
+	if (frame % TELEMETRY_MEMORY_FRAMES == 1 || !telemetry_memory) {
+		telemetry_memory = root_box ? get_box_memory(root_box).subtree : 0;
+		for (auto prototype : prototypes)
+			telemetry_memory += get_box_memory(prototype).subtree;
+		telemetry_memory += get_free_texture_memory();
+	}
+	record.memory = telemetry_memory;
+	telemetry.write(std::move(record));
+}
+
+void game::draw_counted(sf::RenderTarget& target, const sf::Drawable& drawable, const sf::RenderStates& states) {
+
+	// Sprites bring their own texture when the states don't
+	auto texture = states.texture;
+	if (!texture)
+		if (auto sprite = dynamic_cast<const sf::Sprite*>(&drawable))
+			texture = sprite->getTexture();
+	draw_stats.count(&target, texture);
+	target.draw(drawable, states);
+}
+
+void game::apply_perf_profile() {
+
+	// Friction is copied into fixtures, and mixed into contacts, as they're made
+	player.friction = perf.friction;
+	vector<b2World*> worlds;
+	if (outer_world)
+		worlds.push_back(outer_world.get());
+	for (auto box : boxes)
+		if (box->world && !box->prototype)
+			worlds.push_back(box->world.get());
+	for (auto world : worlds) {
+		for (auto body = world->GetBodyList(); body; body = body->GetNext())
+			for (auto fixture = body->GetFixtureList(); fixture; fixture = fixture->GetNext())
+				if (!fixture->IsSensor())
+					fixture->SetFriction(perf.friction);
+		for (auto contact = world->GetContactList(); contact; contact = contact->GetNext())
+			contact->ResetFriction();
+	}
+
+	// Box texture resolution, and whether it follows the frame time
+	render_scale.enabled = perf.dynamic_resolution;
+	render_scale.set_target_frame_time(perf.target_frame_time);
+	float scale = perf.dynamic_resolution ? render_scale.get_scale() : 1;
+	if (!software)
+		set_box_texture_size((unsigned int)(perf.texture_size * scale));
+}
+
+void game::queue_assets() {
+
+	// Start reading and decoding everything in the background. The level
+	// is built while the images, font and shader sources are still loading.
+	assets.queue_image("7grid.png");
+	assets.queue_image("glass.png");
+	assets.queue_image("player.png");
+	assets.queue_image("block.png");
+	assets.queue_file("consola.ttf");
+	for (auto name : { "meta_box", "meta_door", "meta_box_batch" }) {
+		assets.queue_file(string(name) + ".vert");
+		assets.queue_file(string(name) + ".frag");
+	}
+}
+
+void game::load_atlas() {
+
+	// Pack the sprites into the atlas, waiting on any still decoding
+	atlas.add("box_bg", assets.get_image("7grid.png"));
+	atlas.add("box_fg", assets.get_image("glass.png"));
+	atlas.add("player", assets.get_image("player.png"));
+	atlas.add("block", assets.get_image("block.png"));
+	atlas.build(2, !software);
+
+	// Boxes added after this take their regions as they're made;
+	// the level built before it gets them now
+	for (auto box : boxes) {
+		if (box->recursive) continue;
+		box->bg = atlas.get_rect("box_bg");
+		box->fg = atlas.get_rect("box_fg");
+	}
+}
+
+void game::load_shader(sf::Shader& shader, const string& name) {
+	shader_cache.load(shader, name, assets.get_file(name + ".vert"), assets.get_file(name + ".frag"));
+}
+
+void game::setup_world() {
+
 	// Place the root box into a gravity-less root world
 	outer_world = shared_ptr<b2World>(new b2World(b2Vec2(0, 0)));
+	outer_world->SetContactListener(&portal_listener);
 	add_box_hull(root_box, outer_world, (float)BOX_PHYSICAL_SIZE / (float)BOX_SLOTS, 0, 0);
 	//root_box->world = outer_world;
 
 	// Add the player to the first box and give it a body
-	set_player_container(a, b2Vec2(4, 3));
-
-	auto* TEST = new sf::RenderWindow(
-			sf::VideoMode(BOX_RENDER_SIZE, BOX_RENDER_SIZE),
-			"Metabox Surfaces - Proof Of Concept",
-			sf::Style::Close | sf::Style::Titlebar,
-            sf::ContextSettings::ContextSettings(0, 0, 0, 3, 0));
-	delete TEST;
-
-	// Create the main window
-	window = unique_ptr<sf::RenderWindow>(
-		new sf::RenderWindow(
-			sf::VideoMode(BOX_RENDER_SIZE, BOX_RENDER_SIZE),
-			"Metabox Surfaces - Proof Of Concept",
-			sf::Style::Close | sf::Style::Titlebar,
-            sf::ContextSettings::ContextSettings(0, 0, 0, 3, 0)));
-	window->setActive(true);
-
-	// Create a graphical text to display
-	font.loadFromFile("consola.ttf");
-
-	// Load textures
-	box_bg.loadFromFile("7grid.png");
-	box_fg.loadFromFile("glass.png");
-	grid.loadFromFile("7grid.png");
-	player_tex.loadFromFile("player.png");
-	block_tex.loadFromFile("block.png");
-
-	// Load the open-meta-door shader
-	meta_box_shader.loadFromFile("meta_box.vert", "meta_box.frag");
-    meta_door_shader.loadFromFile("meta_door.vert", "meta_door.frag");
+	set_player_container(root_box, b2Vec2(4, 3));
+}
 
-	//
-	//set_mode(Edit);
+void game::setup_graphics(bool headless) {
+
+	// Headless runs render offscreen only, so they get no window
+	if (!headless) {
+
+		// Create the main window
+		window = unique_ptr<sf::RenderWindow>(
+			new sf::RenderWindow(
+				sf::VideoMode(BOX_RENDER_SIZE, BOX_RENDER_SIZE),
+				"Metabox Surfaces - Proof Of Concept",
+				sf::Style::Close | sf::Style::Titlebar,
+				sf::ContextSettings::ContextSettings(0, 0, 0, 3, 0)));
+		window->setActive(true);
+	}
+
+	// Create a graphical text to display. The font file stays in the asset loader.
+	const string& font_data = assets.get_file("consola.ttf");
+	font.loadFromMemory(font_data.data(), font_data.size());
+	text_batch.set_font(&font);
+
+	// Compile the box and door shaders from their loaded sources
+	load_shader(meta_box_shader, "meta_box");
+	load_shader(meta_door_shader, "meta_door");
+	load_shader(meta_box_batch_shader, "meta_box_batch");
 }
 
 void game::teardown() {
-	window->close();
+	if (window)
+		window->close();
+
+	// Write out the frame timeline if it was requested
+	if (trace_on_exit)
+		trace_dump(trace_path);
+	telemetry.close();
 }
 
 void game::run() {
 
-	float dt_min = 1.f / 60.f;
 	float dt_accum = 0;
 	sf::Clock clock;
+	sf::Clock perf_clock;
 	sf::Time t0 = clock.getElapsedTime();
 	sf::Time t1;
 
 	while (mode != Quit) {
+		profiler.begin_frame();
 		
 		t1 = clock.getElapsedTime();
 		float dt = (t1 - t0).asSeconds();
 		fps = 1.f / dt;
 		t0 = t1;
 		dt_accum += dt;
-		while (dt_accum >= dt_min) {
-			dt_accum -= dt_min;
-			step(dt_min);
+		while (dt_accum >= perf.step_time) {
+			dt_accum -= perf.step_time;
+			step(perf.step_time);
 		}
 		
 		draw();
 
+		// Adjust the box texture resolution to the frame time
+		auto draw_section = profiler.get_sections().find("draw");
+		float render_time = draw_section != profiler.get_sections().end() ? draw_section->second.total : 0;
+		if (render_scale.update(profiler.get_frame_time(0), render_time))
+			set_box_texture_size((unsigned int)(perf.texture_size * render_scale.get_scale()));
+
+		// Pick up edits to the performance profile about once a second
+		if (perf_clock.getElapsedTime().asSeconds() > 1) {
+			perf_clock.restart();
+			if (perf.reload_if_changed())
+				apply_perf_profile();
+		}
+
 		// Clear old forces
 		for (auto box : boxes)
 			if (box->world)
 				box->world->ClearForces();
+
+		profiler.end_frame();
+
+		// Outside the timed frame, so writing it out doesn't steer the resolution
+		record_frame_telemetry(render_time);
 	};
 
 	// Perform teardown actions before exiting program
@@ -129,167 +276,56 @@ void game::set_window_size(int width, int height) {
 }
 
 void game::step(float dt) {
+	PROFILE_SCOPE(profiler, "step");
 
 	// If the window has closed, stop the game
-	if (!window->isOpen()) set_mode(Quit);
-
-	// Process events
-	sf::Event event;
-	while (window->pollEvent(event))
-	{
-		// Close window : exit
-		if (event.type == sf::Event::Closed) window->close();
+	if (window && !window->isOpen()) set_mode(Quit);
 
-		// Resize window : change viewport
-		if (event.type == sf::Event::Resized) {
-			// TODO
-		}
+	// Process events and keyboard input
+	process_input();
 
-		//
-		if (event.type == sf::Event::KeyPressed) {
-
-			if (event.key.code == sf::Keyboard::Up || event.key.code == sf::Keyboard::W) {
-				player.body->ApplyForceToCenter(b2Vec2(0, -250), true);
+	// Step all of the box physics worlds
+	sf::Clock step_clock;
+	TelemetryRecord record;
+	record.kind = TelemetryRecord::Step;
+	{
+		PROFILE_SCOPE(profiler, "physics");
+		for (auto box : boxes) {
+			if (!box->world) continue;
+			{
+				TraceScope trace_scope("b2World::Step", box->id);
+				box->world->Step(dt, perf.velocity_iterations, perf.position_iterations);
 			}
 
-			/// TEMP ///
-			if (event.key.code == sf::Keyboard::Q) {
-				if (player.container->children.size()) {
-					auto box = player.container->children.back();
-					box->target_sx += 1;
-				}
+			// Aggregate Box2D's own timings (reported in milliseconds)
+			auto& b2_profile = box->world->GetProfile();
+			if (telemetry.is_open()) {
+				record.worlds.push_back({ box->id, b2_profile.step, b2_profile.collide, b2_profile.solve,
+					b2_profile.solveTOI, b2_profile.broadphase, box->world->GetBodyCount(),
+					box->world->GetContactCount(), box->world->GetProxyCount() });
 			}
-			/// END TEMP ///
+			profiler.add("physics/collide", b2_profile.collide * .001f);
+			profiler.add("physics/solve", b2_profile.solve * .001f);
+			profiler.add("physics/broadphase", b2_profile.broadphase * .001f);
+			profiler.add("physics/toi", b2_profile.solveTOI * .001f);
 		}
 	}
 
-	// Apply forces to the player based on keyboard input
-	if (sf::Keyboard::isKeyPressed(sf::Keyboard::Right) || sf::Keyboard::isKeyPressed(sf::Keyboard::D))
-		player.body->ApplyForceToCenter(b2Vec2(12, 0), true);
-	if (sf::Keyboard::isKeyPressed(sf::Keyboard::Left) || sf::Keyboard::isKeyPressed(sf::Keyboard::A))
-		player.body->ApplyForceToCenter(b2Vec2(-12, 0), true);
-	if (sf::Keyboard::isKeyPressed(sf::Keyboard::Down) || sf::Keyboard::isKeyPressed(sf::Keyboard::S))
-		player.body->ApplyForceToCenter(b2Vec2(0, 5), true);
-
-	// Switch between program modes
-	if (sf::Keyboard::isKeyPressed(sf::Keyboard::F1)) set_mode(Play);
-	else if (sf::Keyboard::isKeyPressed(sf::Keyboard::F2)) set_mode(Edit);
-	else if (sf::Keyboard::isKeyPressed(sf::Keyboard::Escape)) set_mode(Quit);
-
 	// Update all boxes
-	for (auto box : boxes) {
-
-		// Step the box's physics world
-		if (box->world)
-			box->world->Step(dt, 6, 2);
-
-		// Update the box's phsyics body
-		if (box->body) {
-			auto pos = box->body->GetPosition();
-			box->sx = (int)(pos.x * (float)BOX_SLOTS / (float)BOX_PHYSICAL_SIZE);
-			box->sy = (int)(pos.y * (float)BOX_SLOTS / (float)BOX_PHYSICAL_SIZE);
-
-			// If the box is gridded, move it towards its target slot
-			if (box->state == Gridded) {
-				auto target_pos = b2Vec2(
-					(box->target_sx + .5f) * BOX_METERS_PER_SLOT,
-					(box->target_sy + .5f) * BOX_METERS_PER_SLOT);
-				auto diff = target_pos - pos;
-				box->body->SetLinearVelocity(b2Vec2(diff.x * 5, diff.y * 5));
-			}
-
-			// Get pointer to new slot
-			Slot* slot = 0;
-			if (box->parent)
-				slot = &box->parent->slots[box->sx][box->sy];
-
-			// If the box's slot differs from its current slot position,
-			// set the slot and recalculate adjacencies
-			if (slot != box->slot) {
-
-				// Remove from current slot
-                auto old_slot = box->slot;
-				if (old_slot)
-                    old_slot->child = 0;
-
-				// Add to new slot
-                box->slot = slot;
-				if (slot)
-					slot->child = box;
-
-                // Re-calculate box's door adjacencies
-                find_door_adjacencies(box);
-			}
-		}
-
-		// Update door transitions
-		for (auto door : box->doors) {
-			if (door) {
-				if (door->open) {
-					if (door->t < 1)
-						door->t += 3 * dt;
-					else door->t = 1;
-				} else {
-					if (door->t > 0)
-						door->t -= 3 * dt;
-					else door->t = 0;
-				}
-			}
-		}
-	}
+	update_boxes(dt);
+	if (player.body->IsAwake())
+		touch_box(player.container);
 
 	//
 	if (nearest_door && nearest_door->open)
 		open_box_door(nearest_door->box, nearest_door_face, false);
 
-	//
-	nearest_door = 0;
+	// Find the nearest door to the player, from the container's door index
 	float max_door_dist = 2;
 	float nearest_door_dist = max_door_dist;
-
-	// Close/open active metabox doors
-	for (int face = 0; face < 4; face++) {
-		auto door = player.container->doors[face];
-		if (door) {
-
-			// Get distance from player to door
-			auto door_pos = sf::Vector2f(door->slot->x + .5f, door->slot->y + .5f) * BOX_METERS_PER_SLOT;
-			auto player_pos = player.body->GetPosition();
-			auto diff = vec2f(door_pos) - vec2f(player_pos);
-			float dist = diff.length();
-			
-			// If this is the closest door thus far, save it
-			if (dist < nearest_door_dist) {
-				nearest_door = door;
-				nearest_door_dist = dist;
-				nearest_door_face = (BoxFace)face;
-			}
-		}
-	}
-
-	// Close/open sub metabox doors
-	for (auto box : player.container->children) {
-		for (int face = 0; face < 4; face++) {
-			auto door = box->doors[face];
-			if (door) {
-
-				// Get distance from player to door
-				vec2f player_pos = vec2f(player.body->GetPosition());
-				vec2f door_pos = vec2f(box->body->GetPosition())
-							   + vec2f(face == 1 ?  1 : (face == 3 ? -1 : 0),
-									   face == 0 ? -1 : (face == 2 ?  1 : 0)) * .5f;
-				vec2f diff = door_pos - player_pos;
-				float dist = diff.length();
-				
-				// If this is the closest door thus far, save it
-				if (dist < nearest_door_dist) {
-					nearest_door = door;
-					nearest_door_dist = dist;
-					nearest_door_face = (BoxFace)face;
-				}
-			}
-		}
-	}
+	nearest_door = find_nearest_door(player, max_door_dist, nearest_door_dist);
+	if (nearest_door)
+		nearest_door_face = nearest_door->face;
 
 	// If we found a close enough door, open it!
 	if (sf::Keyboard::isKeyPressed(sf::Keyboard::Space) &&
@@ -302,20 +338,38 @@ void game::step(float dt) {
 	//       Once the adjacency system is up we can do it that way. Doing it the right
 	//		 way will prevent the need to separate entering/exiting metaboxes, and will
 	//		 also automatically facilitate "lateral" transitions in the box-tree. Woot.
+	// Portal sensors queue the doorways the player is touching, so nothing
+	// here runs unless the player is actually near an open door.
 	{
 		bool player_transfered = false;
+		bool exiting = false;
+		list<shared_ptr<Box>> entering;
+		for (auto& portal : portal_listener.get_contacts()) {
+			if (portal.entity != &player) continue;
+			if (portal.exit && portal.box == player.container.get())
+				exiting = true;
+			else if (!portal.exit && portal.box->parent == player.container)
+				for (auto child : player.container->children)
+					if (child.get() == portal.box)
+						entering.push_back(child);
+		}
 
 		// If the player has wandered out of a metadoor,
 		// transfer them to the parent box.
 		auto player_pos = player.body->GetPosition();
 		float max_pos = (float)BOX_PHYSICAL_SIZE;
-		if (player_pos.x < 0 || player_pos.y < 0 || player_pos.x > max_pos || player_pos.y > max_pos) {
+		if (exiting && (player_pos.x < 0 || player_pos.y < 0 || player_pos.x > max_pos || player_pos.y > max_pos)) {
 
 			// If the player is leaving the current top recursive meta, then set that as the container.
             // Otherwise, leave it as the current player.container.
 			auto container = player.container;
 			if (!player.recursions.empty() && player.recursions.top()->parent == player.container) {
-                nearest_door->t = 0;
+
+				// The door search can come up empty, e.g. for a player moving fast
+				if (nearest_door) {
+					nearest_door->t = 0;
+					activate_box(nearest_door->box);
+				}
 				container = player.recursions.top();
 			}
 
@@ -333,7 +387,10 @@ void game::step(float dt) {
 
 		// If the player has wandered into a sub-meta door,
 		// transfer them into the child box.
-		for (auto child : player.container->children) {
+		BoxPoint located;
+		if (!entering.empty())
+			located = locate_point(player.container, player.body->GetPosition(), 1);
+		for (auto child : entering) {
 
             // If there is one, find the open door for this child.
 			shared_ptr<BoxDoor> door = 0;
@@ -349,9 +406,8 @@ void game::step(float dt) {
 			if (player_transfered) break;
 
             // Check this child for overlap.
-			for (b2Fixture* fixture = child->body->GetFixtureList(); fixture; fixture = fixture->GetNext()) {
-				if (fixture->GetType() != b2Shape::Type::e_polygon) continue;
-				if (fixture->GetShape()->TestPoint(child->body->GetTransform(), player.body->GetPosition())) {
+			{
+				if (located.box == child) {
 					player_pos -= child->body->GetPosition();
 					player_pos += b2Vec2(
                         door->slot->x * BOX_PHYSICAL_SIZE / BOX_SLOTS,
@@ -359,8 +415,10 @@ void game::step(float dt) {
 					player_pos += b2Vec2(.5f * BOX_PHYSICAL_SIZE / BOX_SLOTS, .5f * BOX_PHYSICAL_SIZE / BOX_SLOTS);
 
                     // If we're transfering to a recursive submeta, open the superdoor
-                    if (child->recursive)
+                    if (child->recursive) {
                         child->parent->doors[door->face]->t = door->t;
+                        activate_box(child->parent);
+                    }
 
                     // Transfer to this child
 					set_player_container(child, player_pos, player.body->GetLinearVelocity());
@@ -385,8 +443,333 @@ void game::step(float dt) {
 	view.x = view.x + (view.tx - view.x) * 3 * dt;
 	view.y = view.y + (view.ty - view.y) * 3 * dt;
 	view.scale = view.scale + (view.tscale - view.scale) * 4 * dt;
+
+	// One telemetry record per step
+	step_count++;
+	if (telemetry.is_open()) {
+		record.frame = frame;
+		record.step = step_count;
+		record.time = step_clock.getElapsedTime().asSeconds();
+		telemetry.write(std::move(record));
+	}
 }
 
+void game::update_boxes(float dt) {
+	PROFILE_SCOPE(profiler, "slots");
+
+	// Only boxes which are moving or have doors mid-transition are visited.
+	// Everything else is at rest, with its body asleep.
+	vector<shared_ptr<Box>> moved_boxes;
+	for (auto it = active_boxes.begin(); it != active_boxes.end();) {
+		auto box = *it;
+		bool settled = true;
+
+		// Moving or animating changes how the box (and so its ancestors) look
+		touch_box(box);
+
+		// Update the box's phsyics body
+		if (box->body) {
+			auto pos = box->body->GetPosition();
+			update_door_anchors(box);
+			box->sx = (int)(pos.x * (float)BOX_SLOTS / (float)BOX_PHYSICAL_SIZE);
+			box->sy = (int)(pos.y * (float)BOX_SLOTS / (float)BOX_PHYSICAL_SIZE);
+
+			// If the box is gridded, move it towards its target slot,
+			// snapping onto it once it's close enough
+			if (box->state == Gridded) {
+				auto target_pos = b2Vec2(
+					(box->target_sx + .5f) * BOX_METERS_PER_SLOT,
+					(box->target_sy + .5f) * BOX_METERS_PER_SLOT);
+				auto diff = target_pos - pos;
+				if (diff.LengthSquared() > BOX_SETTLE_DISTANCE * BOX_SETTLE_DISTANCE) {
+					box->body->SetLinearVelocity(b2Vec2(diff.x * 5, diff.y * 5));
+					settled = false;
+				} else {
+					box->body->SetTransform(target_pos, box->body->GetAngle());
+				}
+			}
+
+			// Free boxes are driven by physics, so they never settle
+			else if (box->state == Free) {
+				settled = false;
+			}
+
+			// Get pointer to new slot
+			Slot* slot = 0;
+			if (box->parent)
+				slot = &box->parent->slots[box->sx][box->sy];
+
+			// If the box's slot differs from its current slot position,
+			// set the slot and recalculate adjacencies
+			if (slot != box->slot) {
+
+				// Remove from current slot, unless another box has already moved in
+                auto old_slot = box->slot;
+				if (old_slot && old_slot->child == box)
+                    old_slot->child = 0;
+
+				// Add to new slot
+                box->slot = slot;
+				if (slot)
+					slot->child = box;
+
+                // Re-calculate the door adjacencies once everything has moved
+                moved_boxes.push_back(box);
+				if (box->parent)
+					invalidate_box_nav(box->parent);
+			}
+		}
+
+		// Update door transitions
+		for (auto door : box->doors) {
+			if (door) {
+				if (door->open) {
+					door->t = std::min(door->t + perf.door_speed * dt, 1.f);
+					settled = settled && door->t >= 1;
+				} else {
+					door->t = std::max(door->t - perf.door_speed * dt, 0.f);
+					settled = settled && door->t <= 0;
+				}
+			}
+		}
+
+		// Put settled boxes to sleep and drop them from the active set
+		if (settled) {
+			if (box->body) {
+				box->body->SetLinearVelocity(b2Vec2(0, 0));
+				box->body->SetAwake(false);
+			}
+			box->active = false;
+			it = active_boxes.erase(it);
+		} else {
+			++it;
+		}
+	}
+
+	// Re-calculate door adjacencies for everything that changed slot
+	for (auto box : moved_boxes)
+		find_door_adjacencies(box);
+}
+
+void game::set_box_target(shared_ptr<Box> box, int sx, int sy) {
+	JournalScope journal_scope(journal);
+	JournalOp op(OpMoveBox, box);
+	op.sx = box->target_sx;
+	op.sy = box->target_sy;
+	op.to_sx = sx;
+	op.to_sy = sy;
+
+	// Hand the claim on the old target slot over to the new one
+	if (box->parent) {
+		auto& old_claim = box->parent->slots[box->target_sx][box->target_sy].claim;
+		if (old_claim == box)
+			old_claim = 0;
+		box->parent->slots[sx][sy].claim = box;
+	}
+
+	box->target_sx = sx;
+	box->target_sy = sy;
+	activate_box(box);
+
+	if (journal_scope.is_outer())
+		journal.record(op);
+}
+
+int game::push_boxes(shared_ptr<Box> parent, const vector<BoxMove>& moves) {
+
+	// Each move pushes the chain of boxes in front of it. Chains are resolved
+	// against the slot claims, which are updated as each one is applied, so a
+	// whole row can be shifted in one pass without waiting on physics.
+	JournalScope journal_scope(journal);
+	JournalOp op(OpPushBoxes, parent);
+	int moved = 0;
+	vector<shared_ptr<Box>> chain;
+	for (auto& move : moves) {
+		if (move.box->parent != parent) continue;
+
+		// Walk forward until an unclaimed slot, giving up at walls, blocks and fixed boxes
+		chain.clear();
+		chain.push_back(move.box);
+		int x = move.box->target_sx;
+		int y = move.box->target_sy;
+		bool blocked = move.box->state == Fixed;
+		while (!blocked) {
+			x += move.dx;
+			y += move.dy;
+			if (x < 0 || y < 0 || x >= BOX_SLOTS || y >= BOX_SLOTS || parent->blocks[x][y]) {
+				blocked = true;
+				break;
+			}
+			auto claim = parent->slots[x][y].claim;
+			if (!claim) break;
+			if (claim->state == Fixed) blocked = true;
+			chain.push_back(claim);
+		}
+		if (blocked) continue;
+
+		// Shift the chain from the front so each box moves into a freed slot
+		for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+			auto box = *it;
+			JournalOp box_move(OpMoveBox, box);
+			box_move.sx = box->target_sx;
+			box_move.sy = box->target_sy;
+			box_move.to_sx = box->target_sx + move.dx;
+			box_move.to_sy = box->target_sy + move.dy;
+			op.moves.push_back(box_move);
+			set_box_target(box, box_move.to_sx, box_move.to_sy);
+			moved++;
+		}
+	}
+
+	// The whole push undoes as one
+	if (moved && journal_scope.is_outer())
+		journal.record(op);
+	return moved;
+}
+
+bool game::edit_slot(shared_ptr<Box> box, int sx, int sy, EditTool tool) {
+	if (!box || box->recursive || sx < 0 || sy < 0 || sx >= BOX_SLOTS || sy >= BOX_SLOTS) return false;
+	JournalCommand command(journal);
+	auto& slot = box->slots[sx][sy];
+
+	// An instance's contents are still its prototype's
+	auto contents = box->prototype ? box->prototype : box;
+	auto& contents_slot = contents->slots[sx][sy];
+	bool free = !contents->blocks[sx][sy] && !contents_slot.claim && !contents_slot.child;
+
+	if (tool == EditBlock || tool == EditBox) {
+		if (!free) return false;
+		if (tool == EditBlock) add_block(box, sx, sy);
+		else add_box(box, sx, sy);
+		return true;
+	}
+
+	// A door in the slot opens or closes, whichever face it's on in a corner
+	for (auto door : box->doors) {
+		if (door && door->slot == &slot) {
+			open_box_door(box, door->face, !door->open);
+			return true;
+		}
+	}
+
+	// Otherwise doors sit in the wall beside an edge slot, one to a face
+	BoxFace face;
+	if (sy == 0) face = Top;
+	else if (sx == BOX_SLOTS - 1) face = Right;
+	else if (sy == BOX_SLOTS - 1) face = Bottom;
+	else if (sx == 0) face = Left;
+	else return false;
+	set_box_door(box, face, &slot, false);
+	return true;
+}
+
+bool game::edit_push(shared_ptr<Box> box, int dx, int dy) {
+
+	// Boxes taken out by undo can't be pushed
+	if (!box || !box->parent || !box->body) return false;
+	JournalCommand command(journal);
+	return push_boxes(box->parent, { { box, dx, dy } }) > 0;
+}
+
+void game::activate_box(shared_ptr<Box> box) {
+	if (box->active) return;
+	box->active = true;
+	active_boxes.push_back(box);
+}
+
+void game::process_input() {
+	PROFILE_SCOPE(profiler, "input");
+
+	// Headless runs take no input
+	if (!window) return;
+
+	// Process events
+	sf::Event event;
+	while (window->pollEvent(event))
+	{
+		// Close window : exit
+		if (event.type == sf::Event::Closed) window->close();
+
+		// Resize window : change viewport
+		if (event.type == sf::Event::Resized) {
+			// TODO
+		}
+
+		// Scroll the editor's box list
+		if (event.type == sf::Event::MouseWheelScrolled && mode == Edit)
+			editor_scroll -= event.mouseWheelScroll.delta * 40.f;
+
+		// Edit the slot under the cursor: a block, or a box with shift, or the door
+		// there with the right button. Clicking a child box selects it for pushing.
+		if (event.type == sf::Event::MouseButtonPressed && mode == Edit) {
+			int sx, sy;
+			auto box = get_editor_slot(sf::Vector2f((float)event.mouseButton.x, (float)event.mouseButton.y), sx, sy);
+			if (box) {
+				auto child = box->slots[sx][sy].claim;
+				bool shift = sf::Keyboard::isKeyPressed(sf::Keyboard::LShift) || sf::Keyboard::isKeyPressed(sf::Keyboard::RShift);
+				if (event.mouseButton.button == sf::Mouse::Right)
+					edit_slot(box, sx, sy, EditDoor);
+				else if (child)
+					editor_selection = child;
+				else
+					edit_slot(box, sx, sy, shift ? EditBox : EditBlock);
+			}
+		}
+
+		//
+		if (event.type == sf::Event::KeyPressed) {
+
+			if (event.key.code == sf::Keyboard::Up || event.key.code == sf::Keyboard::W) {
+				player.body->ApplyForceToCenter(b2Vec2(0, -250), true);
+			}
+
+			// Undo and redo editor changes
+			if (mode == Edit && event.key.control && event.key.code == sf::Keyboard::Z)
+				undo();
+			if (mode == Edit && event.key.control && event.key.code == sf::Keyboard::Y)
+				redo();
+
+			// Page through the editor's box list
+			if (mode == Edit && event.key.code == sf::Keyboard::PageDown)
+				editor_scroll += window->getSize().y * .8f;
+			if (mode == Edit && event.key.code == sf::Keyboard::PageUp)
+				editor_scroll -= window->getSize().y * .8f;
+
+			// Toggle the profiler overlay
+			if (event.key.code == sf::Keyboard::F3)
+				show_profiler = profiler.detailed = !show_profiler;
+
+			// Dump the recent frame timeline
+			if (event.key.code == sf::Keyboard::F4)
+				trace_dump(trace_path);
+
+			// Dump the per-box memory breakdown
+			if (event.key.code == sf::Keyboard::F5)
+				printf("%s", format_memory_report().c_str());
+
+			// Push the selected box, and the boxes in its way
+			if (mode == Edit && editor_selection) {
+				if (event.key.code == sf::Keyboard::Left) edit_push(editor_selection, -1, 0);
+				else if (event.key.code == sf::Keyboard::Right) edit_push(editor_selection, 1, 0);
+				else if (event.key.code == sf::Keyboard::Up) edit_push(editor_selection, 0, -1);
+				else if (event.key.code == sf::Keyboard::Down) edit_push(editor_selection, 0, 1);
+			}
+		}
+	}
+
+	// Apply forces to the player based on keyboard input
+	if (sf::Keyboard::isKeyPressed(sf::Keyboard::Right) || sf::Keyboard::isKeyPressed(sf::Keyboard::D))
+		player.body->ApplyForceToCenter(b2Vec2(12, 0), true);
+	if (sf::Keyboard::isKeyPressed(sf::Keyboard::Left) || sf::Keyboard::isKeyPressed(sf::Keyboard::A))
+		player.body->ApplyForceToCenter(b2Vec2(-12, 0), true);
+	if (sf::Keyboard::isKeyPressed(sf::Keyboard::Down) || sf::Keyboard::isKeyPressed(sf::Keyboard::S))
+		player.body->ApplyForceToCenter(b2Vec2(0, 5), true);
+
+	// Switch between program modes
+	if (sf::Keyboard::isKeyPressed(sf::Keyboard::F1)) set_mode(Play);
+	else if (sf::Keyboard::isKeyPressed(sf::Keyboard::F2)) set_mode(Edit);
+	else if (sf::Keyboard::isKeyPressed(sf::Keyboard::Escape)) set_mode(Quit);
+}
 
 void game::find_door_adjacencies(shared_ptr<Box> box) {
 
@@ -418,8 +801,10 @@ void game::find_door_adjacency(shared_ptr<BoxDoor> door) {
         auto opposing_door = adj_box->doors[(face + 2) % 4];
 
         // If the opposing door lines up with this one, then we have an adjacency!
-        if (((face == Left || face == Right) && door->slot->y == opposing_door->slot->y) ||
-            ((face == Top || face == Bottom) && door->slot->x == opposing_door->slot->x)) {
+        // (The neighbour may have no door on the facing side.)
+        if (opposing_door && (
+            ((face == Left || face == Right) && door->slot->y == opposing_door->slot->y) ||
+            ((face == Top || face == Bottom) && door->slot->x == opposing_door->slot->x))) {
             adjacency = opposing_door;
         }
     }
@@ -434,10 +819,11 @@ void game::find_door_adjacency(shared_ptr<BoxDoor> door) {
         adjacency->adjacency = door;
 
     // If the slots containing this door or it's newly set adjacent door either have a children,
-    // their sub-adjacencies may need updating
-    if (door->slot->child) find_door_adjacency(
+    // their sub-adjacencies may need updating. A recursive box's doors sit in the slot it fills,
+    // so it would otherwise recurse into itself.
+    if (door->slot->child && door->slot->child != door->box) find_door_adjacency(
         door->slot->child->doors[door->face]);
-    if (adjacency && adjacency->slot->child) find_door_adjacency(
+    if (adjacency && adjacency->slot->child && adjacency->slot->child != adjacency->box) find_door_adjacency(
         adjacency->slot->child->doors[door->face]);
 }
 
@@ -485,8 +871,9 @@ Slot* game::get_adjacent_slot(Slot* slot, BoxFace face) {
     Slot* adj_slot = 0;
 
     if (slot->edges(face)) {
+        // Edge slots only lead out through a door on the parent's face
         auto door = slot->parent->doors[face];
-        if (door->adjacency && (
+        if (door && door->adjacency && (
             ((face == Left || face == Right) && door->slot->y == slot->y) ||
             ((face == Top || face == Bottom) && door->slot->x == slot->x))) {
             adj_slot = door->adjacency->slot;
@@ -503,6 +890,16 @@ Slot* game::get_adjacent_slot(Slot* slot, BoxFace face) {
 
 
 void game::draw() {
+	PROFILE_SCOPE(profiler, "draw");
+	frame++;
+	draw_stats.reset();
+	boxes_rendered = 0;
+
+	// Headless runs still render the visible boxes offscreen
+	if (!window) {
+		render_box(player.container->parent ? player.container->parent : player.container);
+		return;
+	}
 
 	// Clear screen
 	window->clear(sf::Color(100, 100, 100));
@@ -511,21 +908,84 @@ void game::draw() {
 	if (mode == Play) render_game();
 	else if (mode == Edit) render_editor();
 
-	// Draw the FPS
-	sf::Text text(to_string((int)fps), font, 12);
-	text.setPosition(sf::Vector2f(2, 2));
-	text.setColor(sf::Color(255, 0, 0, 255));
-	window->draw(text);
+	// Draw the profiler overlay, and all of the HUD text in one go
+	text_batch.clear();
+	text_batch.add(to_string((int)fps), sf::Vector2f(2, 2), 12, sf::Color(255, 0, 0, 255));
+	if (show_profiler)
+		render_profiler();
+	text_batch.draw(*window, &draw_stats);
 
 	// Update the window
+	PROFILE_SCOPE(profiler, "present");
 	window->display();
 }
 
-void game::get_view_transforms(sf::RenderStates& states) {
-	states.transform.translate(sf::Vector2f(window->getSize().x * .5f, window->getSize().x * .5f))
-					.scale(sf::Vector2f(view.scale, view.scale))
-					.translate(sf::Vector2f(view.x, view.y))
-					.translate(-sf::Vector2f(window->getSize().x * .5f, window->getSize().x * .5f));
+void game::render_profiler() {
+
+	// Back the overlay with a dark panel
+	float width = 300;
+	float height = 300;
+	sf::Vector2f origin(window->getSize().x - width - 4, 4);
+	sf::RectangleShape panel(sf::Vector2f(width, height));
+	panel.setPosition(origin);
+	panel.setFillColor(sf::Color(0, 0, 0, 180));
+	draw_counted(*window, panel);
+
+	// Draw the frame time histogram, scaled so that 33ms fills the graph
+	float graph_height = 60;
+	float graph_scale = graph_height / (1.f / 30.f);
+	float bar_width = width / (float)PROFILER_HISTORY;
+	sf::VertexArray bars(sf::PrimitiveType::Quads);
+	for (int i = 0; i < PROFILER_HISTORY; i++) {
+		float frame_time = profiler.get_frame_time(PROFILER_HISTORY - 1 - i);
+		float bar_height = std::min(frame_time * graph_scale, graph_height);
+		float x = origin.x + i * bar_width;
+		float y = origin.y + graph_height;
+		sf::Color color = frame_time > 1.f / 30.f ? sf::Color::Red :
+			(frame_time > 1.f / 60.f ? sf::Color::Yellow : sf::Color::Green);
+		bars.append(sf::Vertex(sf::Vector2f(x, y), color));
+		bars.append(sf::Vertex(sf::Vector2f(x + bar_width, y), color));
+		bars.append(sf::Vertex(sf::Vector2f(x + bar_width, y - bar_height), color));
+		bars.append(sf::Vertex(sf::Vector2f(x, y - bar_height), color));
+	}
+	draw_counted(*window, bars);
+
+	// Mark the 60hz budget on the graph
+	sf::Vertex budget_line[2];
+	budget_line[0].position = origin + sf::Vector2f(0, graph_height - graph_scale / 60.f);
+	budget_line[1].position = origin + sf::Vector2f(width, graph_height - graph_scale / 60.f);
+	budget_line[0].color = budget_line[1].color = sf::Color(255, 255, 255, 120);
+	draw_stats.count(window.get(), 0);
+	window->draw(budget_line, 2, sf::PrimitiveType::Lines);
+
+	// List the frame summary, the top level phases, and the worst offenders
+	string lines = "frame avg " + format_ms(profiler.get_frame_time_avg()) +
+		"  max " + format_ms(profiler.get_frame_time_max()) + "\n";
+	const char* phases[] = { "step", "input", "physics", "slots", "draw", "present" };
+	for (auto phase : phases) {
+		auto section = profiler.get_sections().find(phase);
+		if (section == profiler.get_sections().end()) continue;
+		lines += string(phase) + " " + format_ms(section->second.total) + "\n";
+	}
+	lines += "box textures " + to_string(box_texture_size) + "px\n";
+	lines += "worst:\n";
+	for (auto& section : profiler.get_worst(5))
+		lines += "  " + section.name + " " + format_ms(section.self) + " x" + to_string(section.calls) + "\n";
+
+	// Memory held by the whole tree and by the box the player is in
+	lines += "memory " + format_bytes(get_box_memory(root_box).subtree) +
+		"  active " + format_bytes(get_box_memory(player.container).subtree) + "\n";
+	text_batch.add(lines, origin + sf::Vector2f(4, graph_height + 4), 12, sf::Color::White);
+}
+
+Transform2d game::get_view_transform() {
+	double half = window->getSize().x * .5;
+	Transform2d transform;
+	transform.translate(half, half)
+			 .scale(view.scale, view.scale)
+			 .translate(view.x, view.y)
+			 .translate(-half, -half);
+	return transform;
 }
 
 void game::render_game() {
@@ -546,103 +1006,123 @@ void game::render_game() {
 	// If the active box has a parent
 	if (active_parent) {
 		render_box(active_parent);
-		sf::Sprite sprite(active_parent->texture->getTexture());
+		sf::Sprite sprite(active_parent->texture->getTexture(), get_box_texture_rect(active_parent));
+		sprite.setScale(get_texture_scale(sprite), get_texture_scale(sprite));
 		sf::RenderStates states;
 
-		// Apply view transformations
-		get_view_transforms(states);
-
 		// Apply shaders to the parent box
 		get_box_shader(active_parent, states, !recursive_parent);
 
-		// Up-scale and position the parent box
-		vec2f pos = vec2f(active_child->sx, active_child->sy) * PIXELS_PER_METER * BOX_METERS_PER_SLOT;
-		states.transform.scale(sf::Vector2f(BOX_SLOTS, BOX_SLOTS))
-			  .translate(-pos.toVector2f());
+		// Up-scale and position the parent box relative to the camera,
+		// composing in double precision and converting once
+		double slot_pixels = (double)BOX_RENDER_SIZE / (double)BOX_SLOTS;
+		Transform2d transform = get_view_transform();
+		transform.scale(BOX_SLOTS, BOX_SLOTS)
+				 .translate(-active_child->sx * slot_pixels, -active_child->sy * slot_pixels);
+		states.transform = transform.toTransform();
 
 		// Draw the parent
-		window->draw(sprite, states);
+		draw_counted(*window, sprite, states);
 	}
 
 	// Render the active box (& its visible children) and get its sprite
 	if (!active_parent) render_box(active_box);
-	sf::Sprite sprite(active_box->texture->getTexture());
+	sf::Sprite sprite(active_box->texture->getTexture(), get_box_texture_rect(active_box));
+	sprite.setScale(get_texture_scale(sprite), get_texture_scale(sprite));
 	sf::RenderStates states;
 
 	// Apply view transformations
-	get_view_transforms(states);
+	states.transform = get_view_transform().toTransform();
 
 	// Apply the door shader
 	get_box_shader(active_box, states);
 
 	// Draw the active box
-	window->draw(sprite, states);
+	draw_counted(*window, sprite, states);
 
 	// Draw the foreground texture with alpha inversely-
 	// proportional to the zoom level
 	if (view.scale < 1) {
 		states.shader = 0;
-		sf::Sprite fg_sprite(*active_box->fg);
-		fg_sprite.setColor(sf::Color(255, 255, 255, 255.f * (1 - view.scale)));
+		sf::Sprite fg_sprite(atlas.get_texture(), active_box->fg);
+		fg_sprite.setColor(sf::Color(255, 255, 255, (sf::Uint8)(255. * (1 - view.scale))));
 		fg_sprite.setScale(sf::Vector2f(
-			(float)BOX_RENDER_SIZE / (float)active_box->fg->getSize().x,
-			(float)BOX_RENDER_SIZE / (float)active_box->fg->getSize().y));
-		window->draw(fg_sprite, states);
+			(float)BOX_RENDER_SIZE / (float)active_box->fg.width,
+			(float)BOX_RENDER_SIZE / (float)active_box->fg.height));
+		draw_counted(*window, fg_sprite, states);
 	}
 }
 
 void game::render_editor() {
 
-	// Render the boxes to their textures
-	render_box(root_box);
+	// Lay out every box with its own texture, three per row. The layout
+	// only changes when boxes are added or made unique.
+	if (editor_layout_revision != tree_revision) {
+		editor_layout_revision = tree_revision;
+		editor_boxes.clear();
+		editor_layout.clear();
+		for (auto box : boxes) {
+			if (!box->texture) continue;
+			editor_layout[box->id] = (int)editor_boxes.size();
+			editor_boxes.push_back(box);
+		}
+	}
 
 	// Decide on a box size and max number of boxes per row
-	float box_pad = 26.0f;
-	float box_size = window->getSize().x / 3.0f - 4.0f * box_pad;
+	float box_pad, box_size;
+	int boxes_per_row;
+	get_editor_layout(box_pad, box_size, boxes_per_row);
 	float box_scale = box_size / (float)BOX_RENDER_SIZE;
-	int boxes_per_row = 3;
+	float row_height = box_size + box_pad;
+
+	// Keep the scroll in range, and find the rows that are on screen
+	int rows = ((int)editor_boxes.size() + boxes_per_row - 1) / boxes_per_row;
+	float max_scroll = std::max(0.f, box_pad + rows * row_height - (float)window->getSize().y);
+	editor_scroll = std::min(std::max(editor_scroll, 0.f), max_scroll);
+	int first_row = std::max(0, (int)((editor_scroll - box_pad) / row_height));
+	int last_row = std::min(rows - 1, (int)((editor_scroll + window->getSize().y) / row_height));
+	size_t first = first_row * boxes_per_row;
+	size_t last = std::min(editor_boxes.size(), (size_t)((last_row + 1) * boxes_per_row));
+
+	// Any box's position follows from its index, on screen or not
+	auto get_position = [&](int box_id) {
+		auto it = editor_layout.find(box_id);
+		if (it == editor_layout.end()) return sf::Vector2f();
+		int index = it->second;
+		return sf::Vector2f(
+			box_pad + (index % boxes_per_row) * (box_size + box_pad),
+			box_pad + (index / boxes_per_row) * row_height - editor_scroll);
+	};
 
-	// Draw all the box textures & calculate thier positions
-	sf::Vector2i ipos(0, 0);
-	map<int, sf::Vector2f> box_positions;
-	for (auto box : boxes) {
-		if (!box->texture) continue;
-
-		// Convert the rendered box texture to a sprite and draw it to the screen
-		sf::Sprite sprite(box->texture->getTexture());
-		sprite.setScale(sf::Vector2f(box_scale, box_scale));
-		sf::Vector2f pos(box_pad + ipos.x * (box_size + box_pad), box_pad + ipos.y * (box_size + box_pad));
-		box_positions[box->id] = pos;
-		sprite.setPosition(pos);
-		sf::RenderStates states;
-		get_box_shader(box, states);
-		window->draw(sprite, states);
-
-		// Draw the box's fg texture
-		if (box != player.container) {
-			states.shader = 0;
-			sf::Sprite fg_sprite(*box->fg);
-			fg_sprite.setPosition(pos);
-			fg_sprite.setScale(sf::Vector2f(
-				box_size / (float)box->fg->getSize().x,
-				box_size / (float)box->fg->getSize().y));
-			window->draw(fg_sprite, states);
-		}
+	// Draw the thumbnails of the visible boxes, re-rendering any that changed
+	for (size_t i = first; i < last; i++) {
+		auto box = editor_boxes[i];
+		auto& thumbnail = get_editor_thumbnail(box, (unsigned int)box_size);
+		thumbnail.visible_frame = frame;
+		sf::Sprite sprite(thumbnail.texture->getTexture());
+		sprite.setPosition(get_position(box->id));
+		draw_counted(*window, sprite);
+	}
 
-		// Calculate the next position indices
-		ipos.x++;
-		if (ipos.x >= boxes_per_row) {
-			ipos.x = 0;
-			ipos.y++;
+	// Thumbnails that scrolled out of view give their textures back
+	for (auto it = editor_thumbnails.begin(); it != editor_thumbnails.end();) {
+		if (it->second.visible_frame != frame) {
+			unused_editor_thumbnails.push_back(it->second.texture);
+			it = editor_thumbnails.erase(it);
+		} else {
+			++it;
 		}
 	}
 
-	// Render box overlay data
-	for (auto box : boxes) {
-		if (!box->texture) continue;
+	// Render box overlay data. All of the lines and labels are collected
+	// into the debug and text batches and drawn together at the end.
+	debug_draw.clear();
+	text_batch.clear();
+	for (size_t i = first; i < last; i++) {
+		auto box = editor_boxes[i];
 
 		// Get the position of this box on the gui
-		auto box_position = box_positions[box->id];
+		auto box_position = get_position(box->id);
 
 		// Highlight the active box
 		if (box == player.container) {
@@ -650,78 +1130,22 @@ void game::render_editor() {
 			// TODO
 		}
 
-		// Draw grid
+		// Add the grid lines to the debug batch
+		debug_draw.set_transform(sf::Transform().translate(box_position));
 		for (int i = 0; i < BOX_SLOTS; i++) {
-			sf::Transform transform;
-			transform.translate(box_position);
-			sf::Vertex h_line[2];
-			sf::Vertex v_line[2];
-			v_line[0].position.x = h_line[0].position.y =
-			v_line[1].position.x = h_line[1].position.y = i * box_size / (float)BOX_PHYSICAL_SIZE;
-			v_line[0].position.y = h_line[0].position.x = 0;
-			v_line[1].position.y = h_line[1].position.x = box_size;
-			h_line[0].color = h_line[1].color =
-			v_line[0].color = v_line[1].color = sf::Color(255, 255, 255, 30);
-			window->draw(h_line, 2, sf::PrimitiveType::Lines, sf::RenderStates(transform));
-			window->draw(v_line, 2, sf::PrimitiveType::Lines, sf::RenderStates(transform));
+			float offset = i * box_size / (float)BOX_PHYSICAL_SIZE;
+			sf::Color color(255, 255, 255, 30);
+			debug_draw.add_line(sf::Vector2f(offset, 0), sf::Vector2f(offset, box_size), color);
+			debug_draw.add_line(sf::Vector2f(0, offset), sf::Vector2f(box_size, offset), color);
 		}
 
-		// Draw the wireframes for the fixtures in this box's physics world
-		for (b2Body* body = box->world->GetBodyList(); body; body = body->GetNext()) {
-
-			// Compose the transformation for this body
-			auto pos = body->GetPosition();
-			auto ang = body->GetAngle();
-			sf::Transform transform;
-			transform
-				.translate(box_position)
-				.scale(sf::Vector2f(box_scale, box_scale))
-				.translate(sf::Vector2f(pos.x * PIXELS_PER_METER, pos.y * PIXELS_PER_METER))
-				.rotate(ang * 180.f / 3.14159f);
-
-			// Draw the fixtures
-			for (b2Fixture* fixture = body->GetFixtureList(); fixture; fixture = fixture->GetNext()) {
-
-				// Get the vertices for this fixture
-				sf::VertexArray verts;
-				verts.setPrimitiveType(sf::PrimitiveType::LinesStrip);
-				if (fixture->GetType() == b2Shape::Type::e_polygon) {
-					auto shape = (b2PolygonShape*)fixture->GetShape();
-					int num_verts = shape->GetVertexCount();
-					for (int i_vert = 0; i_vert < num_verts; i_vert++) {
-						auto b2_vert = shape->GetVertex(i_vert);
-						sf::Vertex vert(sf::Vector2f(b2_vert.x * PIXELS_PER_METER, b2_vert.y * PIXELS_PER_METER));
-						vert.color = sf::Color(255, 255, 255, 150);
-						verts.append(vert);
-					}
-					verts.append(verts[0]);
-				}
-				else if (fixture->GetType() == b2Shape::Type::e_chain) {
-					auto shape = (b2ChainShape*)fixture->GetShape();
-					int num_edges = shape->GetChildCount();
-					for (int i_edge = 0; i_edge < num_edges; i_edge++) {
-						b2EdgeShape edge;
-						shape->GetChildEdge(&edge, i_edge);
-						auto b2_vert = edge.m_vertex1;
-						sf::Vertex vert(sf::Vector2f(b2_vert.x * PIXELS_PER_METER, b2_vert.y * PIXELS_PER_METER));
-						vert.color = sf::Color::Green;
-						verts.append(vert);
-					}
-					verts.append(verts[0]);
-				}
-				else if (fixture->GetType() == b2Shape::Type::e_edge) {
-					auto shape = (b2EdgeShape*)fixture->GetShape();
-					sf::Vertex a(sf::Vector2f(shape->m_vertex1.x * PIXELS_PER_METER, shape->m_vertex1.y * PIXELS_PER_METER));
-					sf::Vertex b(sf::Vector2f(shape->m_vertex2.x * PIXELS_PER_METER, shape->m_vertex2.y * PIXELS_PER_METER));
-					a.color = b.color = sf::Color::Green;
-					verts.append(a);
-					verts.append(b);
-				}
-
-				// Draw the vertices
-				window->draw(verts, sf::RenderStates(transform));
-			}
-		}
+		// Add the wireframes for the fixtures in this box's physics world
+		debug_draw.set_transform(sf::Transform()
+			.translate(box_position)
+			.scale(sf::Vector2f(box_scale, box_scale)));
+		box->world->SetDebugDraw(&debug_draw);
+		box->world->DrawDebugData();
+		debug_draw.set_transform(sf::Transform::Identity);
 
 		// Highlight doors if there are any
 		for (int i = 0; i < 4; i++) {
@@ -749,19 +1173,16 @@ void game::render_editor() {
 				rect.setFillColor(sf::Color(255, 0, 0, 50));
 			}
 
-			window->draw(rect, sf::RenderStates(transform));
+			draw_counted(*window, rect, sf::RenderStates(transform));
 
             // Draw line to adjacent door if there is one
             if (door->adjacency) {
-                auto other_body_pos = box_positions[door->adjacency->box->id];
-
-                sf::Vertex line[2];
-                auto body_pos = box->body->GetPosition();
-                line[0].position = box_position + sf::Vector2f(pos.x * box_scale, pos.y * box_scale);
-                line[1].position = box_positions[door->adjacency->box->id] + sf::Vector2f(
-                    door->adjacency->slot->x * BOX_METERS_PER_SLOT * PIXELS_PER_METER * box_scale,
-                    door->adjacency->slot->y * BOX_METERS_PER_SLOT * PIXELS_PER_METER * box_scale);
-                window->draw(line, 2, sf::PrimitiveType::Lines);
+                debug_draw.add_line(
+                    box_position + sf::Vector2f(pos.x * box_scale, pos.y * box_scale),
+                    get_position(door->adjacency->box->id) + sf::Vector2f(
+                        door->adjacency->slot->x * BOX_METERS_PER_SLOT * PIXELS_PER_METER * box_scale,
+                        door->adjacency->slot->y * BOX_METERS_PER_SLOT * PIXELS_PER_METER * box_scale),
+                    sf::Color::White);
             }
 		}
 
@@ -776,191 +1197,539 @@ void game::render_editor() {
 			sf::RectangleShape rect;
 			rect.setPosition(sf::Vector2f(child->sx, child->sy) * size - sf::Vector2f(2, 2));
 			rect.setSize(sf::Vector2f(size + 4, size + 4));
-			rect.setOutlineColor(sf::Color(150, 200, 255, 100));
+			rect.setOutlineColor(child == editor_selection ? sf::Color(255, 220, 80) : sf::Color(150, 200, 255, 100));
 			rect.setFillColor(sf::Color::Transparent);
 			rect.setOutlineThickness(2);
-			window->draw(rect, sf::RenderStates(transform));
+			draw_counted(*window, rect, sf::RenderStates(transform));
 
 			// Child box identifier string
-			sf::Text text(to_string(child->id), font, 12);
-			text.setPosition(sf::Vector2f(child->sx, child->sy) * size + sf::Vector2f(3, 3));
-			text.setColor(sf::Color(0, 0, 0, 255));
-			window->draw(text, sf::RenderStates(transform));
-			text.setPosition(sf::Vector2f(child->sx, child->sy) * size + sf::Vector2f(2, 2));
-			text.setColor(sf::Color(255, 255, 255, 255));
-			window->draw(text, sf::RenderStates(transform));
+			text_batch.add_shadowed(to_string(child->id),
+				box_position + sf::Vector2f(child->sx, child->sy) * size + sf::Vector2f(2, 2), 12, sf::Color::White);
 		}
 
 		// Parent/child arrows
 		if (box->parent) {
-			sf::Vertex line[2];
 			auto body_pos = box->body->GetPosition();
-			line[0].position = box_position;
-			line[1].position = box_positions[box->parent->id] + sf::Vector2f(body_pos.x * PIXELS_PER_METER * box_scale, body_pos.y * PIXELS_PER_METER * box_scale);
-			window->draw(line, 2, sf::PrimitiveType::Lines);
+			debug_draw.add_line(
+				box_position,
+				get_position(box->parent->id) + sf::Vector2f(body_pos.x * PIXELS_PER_METER * box_scale, body_pos.y * PIXELS_PER_METER * box_scale),
+				sf::Color::White);
+		}
+
+		// Add the box identifier string
+		text_batch.add_shadowed(to_string(box->id), box_position + sf::Vector2f(2, 2), 14, sf::Color::White);
+	}
+
+	// Draw all of the collected lines and labels in one go
+	if (!debug_draw.empty())
+		draw_counted(*window, debug_draw);
+	text_batch.draw(*window, &draw_stats);
+}
+
+void game::get_editor_layout(float& box_pad, float& box_size, int& boxes_per_row) {
+	box_pad = 26.0f;
+	box_size = window->getSize().x / 3.0f - 4.0f * box_pad;
+	boxes_per_row = 3;
+}
+
+shared_ptr<Box> game::get_editor_slot(sf::Vector2f point, int& sx, int& sy) {
+
+	// Undo the editor layout back to a box index and a slot inside that box
+	float box_pad, box_size;
+	int boxes_per_row;
+	get_editor_layout(box_pad, box_size, boxes_per_row);
+	float x = point.x - box_pad, y = point.y + editor_scroll - box_pad;
+	if (x < 0 || y < 0) return 0;
+	int column = (int)(x / (box_size + box_pad)), row = (int)(y / (box_size + box_pad));
+	x -= column * (box_size + box_pad);
+	y -= row * (box_size + box_pad);
+	if (column >= boxes_per_row || x >= box_size || y >= box_size) return 0;
+	size_t index = row * boxes_per_row + column;
+	if (index >= editor_boxes.size()) return 0;
+	sx = (int)(x / box_size * BOX_SLOTS);
+	sy = (int)(y / box_size * BOX_SLOTS);
+	return editor_boxes[index];
+}
+
+game::EditorThumbnail& game::get_editor_thumbnail(shared_ptr<Box> box, unsigned int size) {
+	auto& thumbnail = editor_thumbnails[box->id];
+
+	// Take a texture from the pool, or make one at thumbnail size
+	if (!thumbnail.texture) {
+		if (unused_editor_thumbnails.size()) {
+			thumbnail.texture = unused_editor_thumbnails.back();
+			unused_editor_thumbnails.pop_back();
+		} else {
+			thumbnail.texture = shared_ptr<sf::RenderTexture>(new sf::RenderTexture());
+		}
+	}
+	if (thumbnail.texture->getSize().x != size) {
+		thumbnail.texture->create(size, size);
+		thumbnail.texture->setSmooth(true);
+		thumbnail.revision = -1;
+	}
+
+	// Only re-render when the box (or anything inside it) has changed
+	if (thumbnail.revision == box->revision) return thumbnail;
+	thumbnail.revision = box->revision;
+
+	// Draw the box straight into the thumbnail at its size, rather than through
+	// the full-size box textures. It's all atlas sprites, so it's one draw.
+	float scale = (float)size / (float)BOX_RENDER_SIZE;
+	sf::VertexArray verts(sf::PrimitiveType::Quads);
+	append_thumbnail_box(verts, box, sf::Transform().scale(scale, scale), (float)size);
+	if (box != player.container) {
+		sf::Transform fg_transform;
+		fg_transform.scale(
+			(float)size / (float)box->fg.width,
+			(float)size / (float)box->fg.height);
+		append_box_quad(verts, sf::Transform(fg_transform).translate(box->fg.width * .5f, box->fg.height * .5f), box->fg, sf::Color::White);
+	}
+	thumbnail.texture->clear(sf::Color::Transparent);
+	draw_counted(*thumbnail.texture, verts, sf::RenderStates(&atlas.get_texture()));
+	thumbnail.texture->display();
+	return thumbnail;
+}
+
+void game::append_thumbnail_box(sf::VertexArray& verts, shared_ptr<Box> box, const sf::Transform& transform, float pixels) {
+
+	// A simplified render_box(), in box pixels under the transform. Children are
+	// drawn the same way inside it until they get too small to make out, and
+	// doors are drawn as plain walls.
+	auto quad = [&](sf::FloatRect rect, sf::FloatRect tex_rect) {
+		sf::Vector2f corners[4] = {
+			sf::Vector2f(0, 0), sf::Vector2f(1, 0), sf::Vector2f(1, 1), sf::Vector2f(0, 1) };
+		for (auto corner : corners) {
+			verts.append(sf::Vertex(
+				transform.transformPoint(rect.left + corner.x * rect.width, rect.top + corner.y * rect.height),
+				sf::Vector2f(tex_rect.left + corner.x * tex_rect.width, tex_rect.top + corner.y * tex_rect.height)));
+		}
+	};
+	float size = (float)BOX_RENDER_SIZE;
+	quad(sf::FloatRect(0, 0, size, size), sf::FloatRect(box->bg));
+
+	// The player
+	if (player.container == box) {
+		sf::IntRect rect = atlas.get_rect("player");
+		auto position = player.body->GetPosition();
+		quad(sf::FloatRect(
+			position.x * PIXELS_PER_METER - rect.width * .25f,
+			position.y * PIXELS_PER_METER - rect.height * .25f,
+			rect.width * .5f, rect.height * .5f), sf::FloatRect(rect));
+	}
+
+	// Children, each with its fg over it. Recursive ones show this box again.
+	auto draw_children = [&](bool recursive) {
+		for (auto child : box->children) {
+			if (child->recursive != recursive || !child->body) continue;
+			auto source = child->recursive ? box : child->prototype ? child->prototype : child;
+			auto position = child->body->GetPosition();
+			sf::Transform child_transform = transform;
+			child_transform.translate(position.x * PIXELS_PER_METER, position.y * PIXELS_PER_METER)
+				.rotate(child->body->GetAngle() * 180.f / 3.14159f)
+				.scale(1.f / (float)BOX_SLOTS, 1.f / (float)BOX_SLOTS)
+				.translate(size * -.5f, size * -.5f);
+			float child_pixels = pixels / (float)BOX_SLOTS;
+			if (child_pixels >= EDITOR_THUMBNAIL_MIN_BOX)
+				append_thumbnail_box(verts, source, child_transform, child_pixels);
+			else
+				append_box_quad(verts, sf::Transform(child_transform).translate(size * .5f, size * .5f)
+					.scale(size / source->bg.width, size / source->bg.height), source->bg, sf::Color::White);
+			append_box_quad(verts, sf::Transform(child_transform).translate(size * .5f, size * .5f)
+				.scale(size / box->fg.width, size / box->fg.height), box->fg, sf::Color::White);
 		}
+	};
+	draw_children(false);
 
-		// Draw the box identifier string
-		sf::Text text(to_string(box->id), font, 14);
-		text.setPosition(box_position + sf::Vector2f(3, 3));
-		text.setColor(sf::Color(0, 0, 0, 255));
-		window->draw(text);
-		text.setPosition(box_position + sf::Vector2f(2, 2));
-		text.setColor(sf::Color(255, 255, 255, 255));
-		window->draw(text);
+	// Blocks, then walls
+	sf::IntRect block_rect = atlas.get_rect("block");
+	for (int sx = 0; sx < BOX_SLOTS; sx++)
+	for (int sy = 0; sy < BOX_SLOTS; sy++) {
+		if (box->blocks[sx][sy] == 1) {
+			sf::FloatRect rects[4], tex_rects[4];
+			int quads = get_block_quads(sx, sy, block_rect, rects, tex_rects);
+			for (int i = 0; i < quads; i++)
+				quad(rects[i], tex_rects[i]);
+		}
 	}
+	float thickness = 6.f;
+	quad(sf::FloatRect(0, 0, size, thickness), sf::FloatRect(block_rect));
+	quad(sf::FloatRect(size - thickness, 0, thickness, size), sf::FloatRect(block_rect));
+	quad(sf::FloatRect(0, size - thickness, size, thickness), sf::FloatRect(block_rect));
+	quad(sf::FloatRect(0, 0, thickness, size), sf::FloatRect(block_rect));
+
+	draw_children(true);
+}
+
+void game::touch_box(shared_ptr<Box> box) {
+
+	// A box shows everything inside it, so its ancestors change with it
+	Box* top = box.get();
+	for (Box* b = box.get(); b; b = b->parent.get()) {
+		b->revision++;
+		top = b;
+	}
+
+	// A tree that isn't the level's is a prototype's, shown by each of its instances
+	if (top == root_box.get()) return;
+	for (auto instance : boxes)
+		if (instance->prototype.get() == top)
+			touch_box(instance);
 }
 
 void game::render_box(shared_ptr<Box> box) {
 	if (!box->texture) return;
 
-	// Clear the texture
-	box->texture->clear();
+	// Prototypes may be drawn into many slots, but only need rendering once per frame
+	if (box->rendered_frame == frame) return;
+	box->rendered_frame = frame;
+	boxes_rendered++;
+	PROFILE_BOX_SCOPE(profiler, "render_box", box->id);
 
-	// Draw the bg texture
+	// Draw the bg texture. The page is shared with other boxes, so rather than
+	// clearing it, the opaque bg replaces whatever was in the box's cell.
 	{
-		sf::Sprite bg_sprite(*box->bg);
-		float scale = (float)BOX_RENDER_SIZE / (float)box->bg->getSize().x;
+		sf::Sprite bg_sprite(atlas.get_texture(), box->bg);
 		bg_sprite.setScale(sf::Vector2f(
-			(float)BOX_RENDER_SIZE / (float)box->bg->getSize().x,
-			(float)BOX_RENDER_SIZE / (float)box->bg->getSize().y));
-		box->texture->draw(bg_sprite);
+			(float)BOX_RENDER_SIZE / (float)box->bg.width,
+			(float)BOX_RENDER_SIZE / (float)box->bg.height));
+		draw_counted(get_box_target(box), bg_sprite, sf::RenderStates(sf::BlendNone));
 	}
 
 	// If the player is in this box, render him
 	if (player.container == box) {
-		sf::Sprite player_sprite(player_tex);
+		sf::Sprite player_sprite = atlas.get_sprite("player");
 		auto player_physical_position = player.body->GetPosition();
 		auto child_render_pos = sf::Vector2f(player_physical_position.x * PIXELS_PER_METER, player_physical_position.y * PIXELS_PER_METER);
 		player_sprite.setPosition(child_render_pos);
-		player_sprite.setOrigin(sf::Vector2f(player_tex.getSize().x * .5f, player_tex.getSize().y * .5f));
+		player_sprite.setOrigin(sf::Vector2f(
+			player_sprite.getTextureRect().width * .5f,
+			player_sprite.getTextureRect().height * .5f));
 		player_sprite.setScale(sf::Vector2f(.5f, .5f));
-		box->texture->draw(player_sprite);
+		draw_counted(get_box_target(box), player_sprite);
 	}
 
 	// Render and draw non-recursive children
-	for (auto child : box->children)
-		if (!child->recursive)
-			render_child(box, child);
+	render_children(box, false);
 
-	// Draw blocks
+	// Draw blocks. They all come from the atlas, so they go into one batch.
+	sf::IntRect block_rect = atlas.get_rect("block");
+	sf::VertexArray block_batch(sf::PrimitiveType::Quads);
 	for (int sx = 0; sx < BOX_SLOTS; sx++)
 	for (int sy = 0; sy < BOX_SLOTS; sy++) {
 		if (box->blocks[sx][sy] == 1) {
-			sf::Sprite block_sprite(block_tex);
-			sf::Rect<int> rect;
-			rect.left = ceil(sx * block_tex.getSize().x / (float)BOX_SLOTS);
-			rect.top = ceil(sy * block_tex.getSize().y / (float)BOX_SLOTS);
-			rect.width = ceil(BOX_PIXELS_PER_SLOT);
-			rect.height = ceil(BOX_PIXELS_PER_SLOT);
-			block_sprite.setTextureRect(rect);
-			block_sprite.setPosition(sf::Vector2f(sx * BOX_PIXELS_PER_SLOT, sy * BOX_PIXELS_PER_SLOT));
-			box->texture->draw(block_sprite);
+			sf::FloatRect rects[4], tex_rects[4];
+			int quads = get_block_quads(sx, sy, block_rect, rects, tex_rects);
+			for (int i = 0; i < quads; i++)
+				append_atlas_quad(block_batch, rects[i], tex_rects[i]);
 		}
 	}
 
-	// Draw walls
+	// Draw walls over the blocks. Walls without a door join the block batch;
+	// a wall with one needs its own draw for the door shader's parameters, so
+	// the batch is drawn first to keep everything in order.
 	float thickness = 6.f;
+	float side = (float)BOX_SLOTS * (float)BOX_PIXELS_PER_SLOT;
+	sf::FloatRect block_tex_rect(block_rect);
 	for (int face = 0; face < 4; face++) {
-		sf::Sprite block_sprite(block_tex);
 
-        // Stretch out a block-texture. This is not ideal.
-		if ((BoxFace)face == Top || (BoxFace)face == Bottom) {
-			block_sprite.setScale(sf::Vector2f(
-				(float)BOX_SLOTS * (float)BOX_PIXELS_PER_SLOT / block_tex.getSize().x,
-				thickness / block_tex.getSize().y));
-		} else {
-			block_sprite.setScale(sf::Vector2f(
-				thickness / block_tex.getSize().x,
-				(float)BOX_SLOTS * (float)BOX_PIXELS_PER_SLOT / block_tex.getSize().y));
-		}
+        // Stretch out a block-texture along the wall. This is not ideal.
+		sf::FloatRect wall_rect;
+		if ((BoxFace)face == Top) wall_rect = sf::FloatRect(0, 0, side, thickness);
+		else if ((BoxFace)face == Right) wall_rect = sf::FloatRect(side - thickness, 0, thickness, side);
+		else if ((BoxFace)face == Bottom) wall_rect = sf::FloatRect(0, side - thickness, side, thickness);
+		else wall_rect = sf::FloatRect(0, 0, thickness, side);
 
-        // Shift the block texture if necessary.
-		if ((BoxFace)face == Right) {
-			block_sprite.setPosition(sf::Vector2f(BOX_SLOTS * BOX_PIXELS_PER_SLOT - thickness, 0));
-		} else if ((BoxFace)face == Bottom) {
-			block_sprite.setPosition(sf::Vector2f(0, BOX_SLOTS * BOX_PIXELS_PER_SLOT - thickness));
-		}
-
-        // Add open/closed door shader to render states if there's a door in this wall
-        sf::RenderStates states;
         auto door = box->doors[face];
-        if (door) {
-
-            static sf::Clock clock;
-            sf::Time t = clock.getElapsedTime();
-
-            int face_pos;
-            if (face == BoxFace::Top) face_pos = door->slot->x;
-            else if (face == BoxFace::Right) face_pos = door->slot->y;
-            else if (face == BoxFace::Bottom) face_pos = BOX_SLOTS - door->slot->x;
-            else if (face == BoxFace::Left) face_pos = BOX_SLOTS - door->slot->y;
-
-            meta_door_shader.setParameter("t", (door->adjacency ? 1.0f : door->t));
-            meta_door_shader.setParameter("face", face);
-            meta_door_shader.setParameter("face_pos", face_pos);
-            meta_door_shader.setParameter("seed", t.asSeconds());
-            states.shader = &meta_door_shader;
-        }
+		if (!door) {
+			append_atlas_quad(block_batch, wall_rect, block_tex_rect);
+			continue;
+		}
+		if (block_batch.getVertexCount()) {
+			draw_counted(get_box_target(box), block_batch, sf::RenderStates(&atlas.get_texture()));
+			block_batch.clear();
+		}
 
-		box->texture->draw(block_sprite, states);
+        // Add open/closed door shader to render states
+        static sf::Clock clock;
+        sf::Time t = clock.getElapsedTime();
+
+        int face_pos;
+        if (face == BoxFace::Top) face_pos = door->slot->x;
+        else if (face == BoxFace::Right) face_pos = door->slot->y;
+        else if (face == BoxFace::Bottom) face_pos = BOX_SLOTS - door->slot->x;
+        else if (face == BoxFace::Left) face_pos = BOX_SLOTS - door->slot->y;
+
+        sf::FloatRect region = atlas.get_uv_rect("block");
+        meta_door_shader.setParameter("t", (door->adjacency ? 1.0f : door->t));
+        meta_door_shader.setParameter("face", face);
+        meta_door_shader.setParameter("face_pos", face_pos);
+        meta_door_shader.setParameter("seed", t.asSeconds());
+        meta_door_shader.setParameter("region", region.left, region.top, region.width, region.height);
+
+		sf::VertexArray wall(sf::PrimitiveType::Quads);
+		append_atlas_quad(wall, wall_rect, block_tex_rect);
+		sf::RenderStates states(&atlas.get_texture());
+		states.shader = &meta_door_shader;
+		draw_counted(get_box_target(box), wall, states);
 	}
+	if (block_batch.getVertexCount())
+		draw_counted(get_box_target(box), block_batch, sf::RenderStates(&atlas.get_texture()));
 
 	// Draw all recursive children
-	for (auto child : box->children)
-		if (child->recursive)
-			render_child(box, child);
+	render_children(box, true);
 
 	//
 	box->texture->display();
 }
 
-void game::render_child(shared_ptr<Box> parent, shared_ptr<Box> child) {
-
-	// Render the child
-	//if (!child->recursive)
-	//	render_box(child);
-
-	// Get the child's texture
-	shared_ptr<sf::RenderTexture> child_texture = 0;
-	if (child->recursive) {
-		child_texture = parent->texture;
-	} else {
-		render_box(child);
-		child_texture = child->texture;
-	}
-
-	// Draw the child texture to the slot
-	if (child_texture) {
-
-		// Create the render state
-		sf::RenderStates child_states;
+void game::render_children(shared_ptr<Box> parent, bool recursive) {
+
+	// Collect one quad per child, batched by the texture page it's drawn from.
+	// Siblings take cells of the same pages, so most children share a batch, and
+	// recursive children all draw the parent's own cell.
+	map<BoxTexturePage*, sf::VertexArray> batches;
+	sf::VertexArray fg_batch(sf::PrimitiveType::Quads);
+	for (auto child : parent->children) {
+		if (child->recursive != recursive) continue;
+
+		// Get the box whose texture the child shows
+		shared_ptr<Box> source;
+		if (child->recursive) {
+			source = parent;
+		} else if (child->prototype) {
+			source = child->prototype;
+			render_box(source);
+		} else {
+			source = child;
+			render_box(source);
+		}
+		if (!source->texture) continue;
 
 		// Calculate the child transform
 		auto child_physical_pos = child->body->GetPosition();
 		auto child_physical_ang = child->body->GetAngle();
 		auto child_render_pos = sf::Vector2f(child_physical_pos.x * PIXELS_PER_METER, child_physical_pos.y * PIXELS_PER_METER);
-		child_states.transform.translate(child_render_pos)
+		sf::Transform transform;
+		transform.translate(child_render_pos)
 			.rotate(child_physical_ang * 180.f / 3.14159f)
 			.scale(sf::Vector2f(1.f / (float)BOX_SLOTS, 1.f / (float)BOX_SLOTS));
 
-		// Set up the child shader if necessary
-		get_box_shader(child, child_states);
+		// Pack the child's door transition into the vertex color, and its cell in the page into the alpha
+		float t = 0;
+		int face = 0;
+		int face_pos = 0;
+		get_box_door_transition(child, t, face, face_pos);
+		sf::Color door_color(
+			(sf::Uint8)(std::min(t, 1.f) * 255.f),
+			(sf::Uint8)(face * 85),
+			(sf::Uint8)(face_pos * 32),
+			(sf::Uint8)source->texture_cell);
+
+		// Add the child texture quad to its page's batch
+		auto& batch = batches[source->texture.get()];
+		batch.setPrimitiveType(sf::PrimitiveType::Quads);
+		sf::IntRect texture_rect = get_box_texture_rect(source);
+		float texture_scale = (float)BOX_RENDER_SIZE / (float)texture_rect.width;
+		append_box_quad(batch, sf::Transform(transform).scale(texture_scale, texture_scale),
+			texture_rect, door_color);
+
+		// Add the child's fg quad, stretched over the whole child
+		sf::Transform fg_transform = transform;
+		fg_transform.scale(sf::Vector2f(
+			(float)BOX_RENDER_SIZE / (float)parent->fg.width,
+			(float)BOX_RENDER_SIZE / (float)parent->fg.height));
+		append_box_quad(fg_batch, fg_transform, parent->fg, sf::Color::White);
+	}
+
+	// Set the shared shader parameters once for every batch
+	static sf::Clock clock;
+	sf::RenderStates states;
+	meta_box_batch_shader.setParameter("entropy", (float)player.recursions.size());
+	meta_box_batch_shader.setParameter("seed", clock.getElapsedTime().asSeconds());
+	meta_box_batch_shader.setParameter("cell_size", (float)box_texture_size);
+	states.shader = &meta_box_batch_shader;
+
+	// Draw the child textures, then all of the fg glass on top
+	for (auto& batch : batches) {
+		states.texture = &batch.first->getTexture();
+		meta_box_batch_shader.setParameter("columns", (float)batch.first->columns);
+		draw_counted(get_box_target(parent), batch.second, states);
+	}
+	if (fg_batch.getVertexCount()) {
+		states.shader = 0;
+		states.texture = &atlas.get_texture();
+		draw_counted(get_box_target(parent), fg_batch, states);
+	}
+}
+
+void game::append_box_quad(sf::VertexArray& verts, const sf::Transform& transform, sf::IntRect tex_rect, sf::Color color) {
+
+	// Emit the corners of a rect-sized quad centered on the transform's origin
+	vec2f size(tex_rect.width, tex_rect.height);
+	sf::Vector2f corners[4] = {
+		sf::Vector2f(0, 0), sf::Vector2f(size.x, 0),
+		sf::Vector2f(size.x, size.y), sf::Vector2f(0, size.y) };
+	for (auto corner : corners) {
+		verts.append(sf::Vertex(
+			transform.transformPoint(corner - sf::Vector2f(size.x * .5f, size.y * .5f)),
+			color, corner + sf::Vector2f(tex_rect.left, tex_rect.top)));
+	}
+}
 
-		// Draw the child texture
-		sf::Sprite child_sprite(child_texture->getTexture());
-		child_sprite.setOrigin(sf::Vector2f(BOX_PHYSICAL_SIZE * PIXELS_PER_METER * .5f, BOX_PHYSICAL_SIZE * PIXELS_PER_METER * .5f));
-		parent->texture->draw(child_sprite, child_states);
+// One axis of a block's window onto the block sprite: the part inside the sprite,
+// then past its edge, if the window runs over, the last texel stretched
+static int split_block_axis(int slot, int origin, int extent, float pos[2], float span[2], float tex_pos[2], float tex_span[2]) {
+	float size = ceilf(BOX_PIXELS_PER_SLOT);
+	float start = ceilf(slot * extent / (float)BOX_SLOTS);
+	float inside = std::min(size, extent - start);
+	pos[0] = slot * BOX_PIXELS_PER_SLOT;
+	span[0] = tex_span[0] = inside;
+	tex_pos[0] = origin + start;
+	if (inside >= size) return 1;
+	pos[1] = pos[0] + inside;
+	span[1] = size - inside;
+	tex_pos[1] = origin + extent - .5f;
+	tex_span[1] = 0;
+	return 2;
+}
 
-		// Draw the child's fg texture
-		child_states.shader = 0;
-		sf::Sprite fg_sprite(*parent->fg);
-		fg_sprite.setOrigin((vec2f(parent->fg->getSize()) * .5f).toVector2f());
-		fg_sprite.setScale(sf::Vector2f(
-			(float)BOX_RENDER_SIZE / (float)parent->fg->getSize().x,
-			(float)BOX_RENDER_SIZE / (float)parent->fg->getSize().y));
-		parent->texture->draw(fg_sprite, child_states);
+int game::get_block_quads(int sx, int sy, sf::IntRect block_rect, sf::FloatRect rects[4], sf::FloatRect tex_rects[4]) {
+
+	// Each block shows an unscaled slot-sized window onto the block sprite, moving
+	// 1/7 of the way across it per slot. Where that runs off the sprite, its edge
+	// is stretched, as clamping did when the sprite had a texture of its own.
+	float x[2], width[2], tex_x[2], tex_width[2];
+	float y[2], height[2], tex_y[2], tex_height[2];
+	int columns = split_block_axis(sx, block_rect.left, block_rect.width, x, width, tex_x, tex_width);
+	int rows = split_block_axis(sy, block_rect.top, block_rect.height, y, height, tex_y, tex_height);
+
+	int quads = 0;
+	for (int i = 0; i < columns; i++)
+	for (int j = 0; j < rows; j++) {
+		rects[quads] = sf::FloatRect(x[i], y[j], width[i], height[j]);
+		tex_rects[quads] = sf::FloatRect(tex_x[i], tex_y[j], tex_width[i], tex_height[j]);
+		quads++;
 	}
+	return quads;
+}
+
+void game::append_atlas_quad(sf::VertexArray& verts, sf::FloatRect rect, sf::FloatRect tex_rect) {
+	verts.append(sf::Vertex(sf::Vector2f(rect.left, rect.top), sf::Vector2f(tex_rect.left, tex_rect.top)));
+	verts.append(sf::Vertex(sf::Vector2f(rect.left + rect.width, rect.top), sf::Vector2f(tex_rect.left + tex_rect.width, tex_rect.top)));
+	verts.append(sf::Vertex(sf::Vector2f(rect.left + rect.width, rect.top + rect.height), sf::Vector2f(tex_rect.left + tex_rect.width, tex_rect.top + tex_rect.height)));
+	verts.append(sf::Vertex(sf::Vector2f(rect.left, rect.top + rect.height), sf::Vector2f(tex_rect.left, tex_rect.top + tex_rect.height)));
+}
+
+bool game::get_box_door_transition(shared_ptr<Box> box, float& t, int& face, int& face_pos) {
+
+	// Find the first door which is mid-transition
+	for (int i = 0; i < 4; i++) {
+		auto door = box->doors[i];
+		if (door && door->t > 0) {
+			if (i == BoxFace::Top) face_pos = door->slot->x;
+			else if (i == BoxFace::Right) face_pos = door->slot->y;
+			else if (i == BoxFace::Bottom) face_pos = BOX_SLOTS - door->slot->x;
+			else if (i == BoxFace::Left) face_pos = BOX_SLOTS - door->slot->y;
+
+			t = door->t;
+			face = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+BoxMemory game::get_box_memory(shared_ptr<Box> box, int depth) {
+	BoxMemory memory;
+	memory.id = box->id;
+	memory.depth = depth;
+
+	// Recursive boxes borrow their parent's world and texture, so they only cost the box itself
+	measure_world(box->world.get(), memory);
+	if (box->texture && !box->recursive)
+		memory.texture = box_texture_size * box_texture_size * 4;
+
+	memory.slots = sizeof(box->slots) + sizeof(box->blocks);
+	memory.box = sizeof(Box) - memory.slots;
+	for (auto door : box->doors)
+		if (door) memory.box += sizeof(BoxDoor);
+	memory.box += box->children.size() * (sizeof(shared_ptr<Box>) + 2 * sizeof(void*));
+
+	memory.entities = box->entities.size() * sizeof(Entity);
+	if (player.container == box)
+		memory.entities += sizeof(Player);
+
+	// Fold in the children
+	memory.subtree = memory.self();
+	for (auto child : box->children)
+		memory.subtree += get_box_memory(child, depth + 1).subtree;
+	return memory;
+}
+
+vector<BoxMemory> game::get_memory_report() {
+
+	// Walk the tree depth-first so that each box is followed by its subtree
+	vector<BoxMemory> report;
+	std::function<void(shared_ptr<Box>, int)> visit = [&](shared_ptr<Box> box, int depth) {
+		report.push_back(get_box_memory(box, depth));
+		for (auto child : box->children)
+			visit(child, depth + 1);
+	};
+	if (root_box)
+		visit(root_box, 0);
+	for (auto prototype : prototypes)
+		visit(prototype, 0);
+
+	// Pages are made a few cells at a time, so some are always waiting for a box
+	BoxMemory free_pages;
+	free_pages.id = BOX_MEMORY_FREE_PAGES;
+	free_pages.texture = get_free_texture_memory();
+	free_pages.subtree = free_pages.self();
+	report.push_back(free_pages);
+	return report;
+}
+
+size_t game::get_free_texture_memory() {
+	size_t cells = 0;
+	for (auto& unused : unused_box_textures)
+		cells += unused.size();
+	return cells * box_texture_size * box_texture_size * 4;
+}
+
+string game::format_memory_report() {
+	string report = "box        self     subtree   world   stack  blocks texture   slots\n";
+	for (auto& memory : get_memory_report()) {
+		char line[256];
+		if (memory.id == BOX_MEMORY_FREE_PAGES) {
+			snprintf(line, sizeof(line), "%-16s %9s %7s %7s %7s %7s\n", "pages (free)",
+				format_bytes(memory.subtree).c_str(), "", "", "", format_bytes(memory.texture).c_str());
+			report += line;
+			continue;
+		}
+		snprintf(line, sizeof(line), "%*s%-*d %9s %9s %7s %7s %7s %7s %7s\n",
+			memory.depth * 2, "", 6 - memory.depth * 2 > 0 ? 6 - memory.depth * 2 : 0, memory.id,
+			format_bytes(memory.self()).c_str(), format_bytes(memory.subtree).c_str(),
+			format_bytes(memory.world + memory.world_broadphase).c_str(), format_bytes(memory.world_stack).c_str(),
+			format_bytes(memory.world_blocks).c_str(), format_bytes(memory.texture).c_str(),
+			format_bytes(memory.slots).c_str());
+		report += line;
+	}
+	return report;
+}
+
+string game::format_bytes(size_t bytes) {
+	char buffer[32];
+	if (bytes >= 1024 * 1024) snprintf(buffer, sizeof(buffer), "%.1fM", bytes / (1024.f * 1024.f));
+	else if (bytes >= 1024) snprintf(buffer, sizeof(buffer), "%.1fK", bytes / 1024.f);
+	else snprintf(buffer, sizeof(buffer), "%dB", (int)bytes);
+	return buffer;
+}
+
+string game::format_ms(float seconds) {
+	char buffer[32];
+	snprintf(buffer, sizeof(buffer), "%.2fms", seconds * 1000.f);
+	return buffer;
 }
 
 void game::get_box_shader(shared_ptr<Box> box, sf::RenderStates& render_states, bool door_shader, bool entropy_shader) {
@@ -978,23 +1747,23 @@ void game::get_box_shader(shared_ptr<Box> box, sf::RenderStates& render_states,
 	}
 
 	// Set the door transition
-	if (door_shader) {
-		for (int face = 0; face < 4; face++) {
-			auto door = box->doors[face];
-			if (door && door->t > 0) {
-				int face_pos;
-				if (face == BoxFace::Top) face_pos = door->slot->x;
-				else if (face == BoxFace::Right) face_pos = door->slot->y;
-				else if (face == BoxFace::Bottom) face_pos = BOX_SLOTS - door->slot->x;
-				else if (face == BoxFace::Left) face_pos = BOX_SLOTS - door->slot->y;
-
-				meta_box_shader.setParameter("t", door->t);
-				meta_box_shader.setParameter("face", face);
-				meta_box_shader.setParameter("face_pos", face_pos);
+	float door_t;
+	int face, face_pos;
+	if (door_shader && get_box_door_transition(box, door_t, face, face_pos)) {
+		meta_box_shader.setParameter("t", door_t);
+		meta_box_shader.setParameter("face", face);
+		meta_box_shader.setParameter("face_pos", face_pos);
+	}
 
-				break;
-			}
-		}
+	// Tell it where the box's cell is in its page. Pages are flipped in uv
+	// coordinates, so the cell's rows count up from the bottom.
+	if (box->texture) {
+		unsigned int columns = box->texture->columns;
+		float cell = 1.f / (float)columns;
+		int column = box->texture_cell % columns;
+		int row = box->texture_cell / columns;
+		meta_box_shader.setParameter("region", column * cell, 1.f - (row + 1) * cell, cell, cell);
+		meta_box_shader.setParameter("cell_size", (float)box_texture_size);
 	}
 
 	// Set the shader pointer
@@ -1002,12 +1771,20 @@ void game::get_box_shader(shared_ptr<Box> box, sf::RenderStates& render_states,
 		render_states.shader = &meta_box_shader;
 }
 
-shared_ptr<Box> game::add_box(shared_ptr<Box> parent, int sx, int sy, bool recursive) {
+shared_ptr<Box> game::add_box(shared_ptr<Box> parent, int sx, int sy, bool recursive, shared_ptr<Box> prototype) {
+
+	JournalScope journal_scope(journal);
+
+	// Adding a child to a prototype instance makes its contents diverge
+	auto shared = parent ? parent->prototype : 0;
+	if (shared)
+		make_box_unique(parent);
 
 	// Create the box & add it to the box list
 	auto box = shared_ptr<Box>(new Box());
 	box->id = next_box_id ++;
 	boxes.push_back(box);
+	tree_revision++;
 
 	// Set the initial box state
 	box->sx = box->target_sx = sx;
@@ -1016,21 +1793,30 @@ shared_ptr<Box> game::add_box(shared_ptr<Box> parent, int sx, int sy, bool recur
 
 	// Set recursiveness
 	box->recursive = recursive;
+	box->prototype = recursive ? 0 : prototype;
+
+	// Instances borrow their prototype's world and texture until they diverge
+	if (box->prototype) {
+		box->bg = prototype->bg;
+		box->fg = prototype->fg;
+		for (int i = 0; i < 4; i++) {
+			auto door = prototype->doors[i];
+			if (door)
+				set_box_door(box, (BoxFace)i, &box->slots[door->slot->x][door->slot->y], door->open);
+		}
+	}
 
 	// If it's not recursive, do stuff for normal boxes that doesn't apply to recursive boxes.
-	if (!recursive) {
+	else if (!recursive) {
 
 		// Set bg and fg textures
-		box->bg = &box_bg;
-		box->fg = &box_fg;
+		box->bg = atlas.get_rect("box_bg");
+		box->fg = atlas.get_rect("box_fg");
 
 		// Generate a physics world for the new box
 		box->world = shared_ptr<b2World>(new b2World(b2Vec2(0, GRAVITY)));
+		box->world->SetContactListener(&portal_listener);
 		generate_world_edges(box);
-
-		// Give the box a texture space
-		// TEMP
-		assign_box_texture(box);
 	}
 
 	// If it's recursive, set the same doors on it as it's parent
@@ -1045,19 +1831,95 @@ shared_ptr<Box> game::add_box(shared_ptr<Box> parent, int sx, int sy, bool recur
 
 	// If this box is a child of another box...
 	if (parent) {
+		parent->door_index.dirty = true;
+		touch_box(parent);
 
 		// Add the box to its parent's child list
 		box->parent = parent;
 		parent->children.push_back(box);
+		parent->slots[sx][sy].claim = box;
 
 		// Add
 		add_box_hull(box, parent->world, (float)BOX_PHYSICAL_SIZE / (float)BOX_SLOTS, sx, sy);
 	}
 
-	//
+	// Give the box a texture space, once its depth is known
+	if (!recursive && !box->prototype)
+		assign_box_texture(box);
+
+	// Let the new box settle into its slot
+	activate_box(box);
+
+	// Undoing the add keeps the box, its world and anything added to it since,
+	// which the later edits count for themselves. Its texture is given back.
+	if (journal_scope.is_outer()) {
+		JournalOp op(OpAddBox, box);
+		auto memory = get_box_memory(box);
+		op.kept = memory.self() - memory.texture;
+		if (shared)
+			note_made_unique(op, parent, shared);
+		journal.record(op);
+	}
 	return box;
 }
 
+shared_ptr<Box> game::add_prototype() {
+
+	// A detached box, simulated and rendered once no matter how many slots show it
+	auto prototype = add_box();
+	prototypes.push_back(prototype);
+	return prototype;
+}
+
+shared_ptr<Box> game::add_box_instance(shared_ptr<Box> parent, int sx, int sy, shared_ptr<Box> prototype) {
+
+	// Instances of instances share the original
+	while (prototype->prototype)
+		prototype = prototype->prototype;
+
+	return add_box(parent, sx, sy, false, prototype);
+}
+
+void game::make_box_unique(shared_ptr<Box> box) {
+	auto prototype = box->prototype;
+	if (!prototype) return;
+	JournalScope journal_scope(journal);
+	box->prototype = 0;
+	box->door_index.dirty = true;
+	invalidate_box_nav(box);
+	tree_revision++;
+
+	// Give the box its own world and texture, with walls matching its own doors
+	box->world = shared_ptr<b2World>(new b2World(b2Vec2(0, GRAVITY)));
+	box->world->SetContactListener(&portal_listener);
+	generate_world_edges(box);
+	assign_box_texture(box);
+
+	// Copy the prototype's blocks
+	for (int sx = 0; sx < BOX_SLOTS; sx++)
+	for (int sy = 0; sy < BOX_SLOTS; sy++)
+		if (prototype->blocks[sx][sy])
+			add_block(box, sx, sy);
+
+	// The prototype's children become instances of themselves, so
+	// the copy only goes one level deep until those diverge too
+	for (auto child : prototype->children) {
+		if (child->recursive)
+			add_box(box, child->target_sx, child->target_sy, true);
+		else
+			add_box_instance(box, child->target_sx, child->target_sy, child);
+	}
+}
+
+void game::note_made_unique(JournalOp& op, shared_ptr<Box> box, shared_ptr<Box> prototype) {
+
+	// Undo keeps the copied contents aside, so redo can bring back the same boxes
+	op.unique = box;
+	op.prototype = prototype;
+	op.unique_contents = shared_ptr<Box>(new Box());
+	op.kept += get_box_memory(box).subtree;
+}
+
 void game::add_box_hull(shared_ptr<Box> box, shared_ptr<b2World> world, float size, int sx, int sy) {
 
 	// Create the new box's physics body in the parent's world
@@ -1072,20 +1934,38 @@ void game::add_box_hull(shared_ptr<Box> box, shared_ptr<b2World> world, float si
 	b2PolygonShape box_shape;
 	box_shape.SetAsBox(size * .5f, size * .5f);
 	auto fixture = box->body->CreateFixture(&box_shape, 1);
-	fixture->SetFriction(FRICTION);
+	fixture->SetFriction(perf.friction);
 	b2Filter filter;
 	filter.categoryBits = B2_CAT_BOX_HULL;
 	filter.maskBits = B2_CAT_MAIN | B2_CAT_BOX_HULL;
 	fixture->SetFilterData(filter);
 
+	// Add the enter portal, a sensor over the whole hull
+	b2FixtureDef portal_def;
+	portal_def.shape = &box_shape;
+	portal_def.isSensor = true;
+	portal_def.userData = box.get();
+	portal_def.filter.categoryBits = B2_CAT_PORTAL;
+	portal_def.filter.maskBits = B2_CAT_MAIN;
+	box->body->CreateFixture(&portal_def);
+
 	// Add the box's toggleable edges
 	generate_box_edges(box);
 }
 
 void game::add_block(shared_ptr<Box> parent, int sx, int sy) {
+	JournalScope journal_scope(journal);
+	if (parent->blocks[sx][sy]) return;
+
+	// Adding a block to a prototype instance makes its contents diverge
+	auto shared = parent->prototype;
+	if (shared)
+		make_box_unique(parent);
 
 	// Set the box flag
 	parent->blocks[sx][sy] = 1;
+	touch_box(parent);
+	invalidate_box_nav(parent);
 
 	// Create the physics
 	float size = (float)BOX_PHYSICAL_SIZE / (float)BOX_SLOTS;
@@ -1096,25 +1976,245 @@ void game::add_block(shared_ptr<Box> parent, int sx, int sy) {
 	b2PolygonShape box_shape;
 	box_shape.SetAsBox(size * .5f, size * .5f);
 	auto fixture = body->CreateFixture(&box_shape, 1);
-	fixture->SetFriction(FRICTION);
+	fixture->SetFriction(perf.friction);
 	b2Filter filter;
 	filter.categoryBits = B2_CAT_MAIN;
 	filter.maskBits = B2_CAT_MAIN;
 	fixture->SetFilterData(filter);
+	parent->block_bodies[sx][sy] = body;
+
+	if (journal_scope.is_outer()) {
+		JournalOp op(OpAddBlock, parent);
+		op.sx = sx;
+		op.sy = sy;
+		if (shared)
+			note_made_unique(op, parent, shared);
+		journal.record(op);
+	}
+}
+
+void game::remove_block(shared_ptr<Box> parent, int sx, int sy) {
+	if (!parent->blocks[sx][sy]) return;
+	parent->blocks[sx][sy] = 0;
+	touch_box(parent);
+	invalidate_box_nav(parent);
+	if (parent->block_bodies[sx][sy]) {
+		parent->world->DestroyBody(parent->block_bodies[sx][sy]);
+		parent->block_bodies[sx][sy] = 0;
+	}
+}
+
+void game::create_box_texture(BoxTexturePage& page) {
+
+	// A page of box textures, each cell box_texture_size across. Pages never
+	// grow past what fits at full resolution, so lowering the size never moves a cell.
+	if (!max_box_texture_columns) {
+		max_box_texture_columns = BOX_TEXTURE_PAGE_COLUMNS;
+		unsigned int max_size = sf::Texture::getMaximumSize();
+		if (max_size && max_box_texture_columns * BOX_RENDER_SIZE > max_size)
+			max_box_texture_columns = std::max(1u, max_size / BOX_RENDER_SIZE);
+	}
+	page.create(box_texture_size * page.columns, box_texture_size * page.columns);
+	page.setSmooth(box_texture_size < BOX_RENDER_SIZE);
+}
+
+void game::set_box_texture_size(unsigned int size) {
+	box_texture_size = size;
+	for (auto& layer : box_textures)
+		for (auto texture : layer)
+			create_box_texture(*texture);
+}
+
+sf::IntRect game::get_box_texture_rect(shared_ptr<Box> box) {
+	if (!box->texture) return sf::IntRect();
+	int size = (int)box_texture_size;
+	int columns = (int)box->texture->columns;
+	return sf::IntRect(box->texture_cell % columns * size, box->texture_cell / columns * size, size, size);
+}
+
+sf::RenderTexture& game::get_box_target(shared_ptr<Box> box) {
+
+	// Box textures may be rendered below full resolution, so draw to
+	// them through a view of the full logical size, onto the box's cell
+	unsigned int columns = box->texture->columns;
+	float cell = 1.f / (float)columns;
+	sf::View view(sf::FloatRect(0, 0, BOX_RENDER_SIZE, BOX_RENDER_SIZE));
+	view.setViewport(sf::FloatRect(
+		(float)(box->texture_cell % columns) * cell,
+		(float)(box->texture_cell / columns) * cell,
+		cell, cell));
+	box->texture->setView(view);
+	return *box->texture;
+}
+
+float game::get_texture_scale(const sf::Sprite& sprite) {
+	return (float)BOX_RENDER_SIZE / (float)sprite.getTextureRect().width;
 }
 
 void game::assign_box_texture(shared_ptr<Box> box) {
-	shared_ptr<sf::RenderTexture> texture;
-	if (unused_box_textures.size() > 0) {
-		texture = *unused_box_textures.end();
-		unused_box_textures.pop_back();
+
+	// Software rendering keeps its own textures, and there may be no GL to make these
+	if (software) return;
+
+	// Boxes share pages of cells, so a box's children can be drawn from one page
+	// in one call
+	int layer = get_box_texture_layer(box);
+	auto& pages = box_textures[layer];
+	auto& unused = unused_box_textures[layer];
+	if (unused.empty()) {
+
+		// Pages start a cell across and double until they're full size, so only
+		// about as many cells are made as there are boxes. Every box is re-rendered
+		// before it's drawn, so its cell moving as the page grows doesn't matter.
+		// Each prototype keeps a page of its own.
+		if (layer != BOX_TEXTURE_LAYERS - 1 && !pages.empty() &&
+			pages.back()->columns * 2 <= max_box_texture_columns) {
+			auto page = pages.back();
+			unsigned int cells = page->columns * page->columns;
+			page->columns *= 2;
+			create_box_texture(*page);
+			for (unsigned int cell = cells; cell < page->columns * page->columns; cell++)
+				unused.push_back({ page, (int)cell });
+		} else {
+			auto page = shared_ptr<BoxTexturePage>(new BoxTexturePage());
+			create_box_texture(*page);
+			pages.push_back(page);
+			unused.push_back({ page, 0 });
+		}
 	}
-	else {
-		texture = shared_ptr<sf::RenderTexture>(new sf::RenderTexture());
-		texture->create(BOX_RENDER_SIZE, BOX_RENDER_SIZE);
-		box_textures.push_back(texture);
+	box->texture = unused.front().page;
+	box->texture_cell = unused.front().cell;
+	unused.pop_front();
+}
+
+int game::get_box_texture_layer(shared_ptr<Box> box) {
+
+	// A prototype is shown in parents of any depth, even other prototypes, so
+	// each gets a page of its own. Every other box uses the other depth layer's
+	// pages to its parent's.
+	if (!box->parent && root_box && box != root_box)
+		return BOX_TEXTURE_LAYERS - 1;
+	int depth = 0;
+	for (auto parent = box->parent; parent; parent = parent->parent)
+		depth++;
+	return depth % (BOX_TEXTURE_LAYERS - 1);
+}
+
+void game::release_box_texture(shared_ptr<Box> box) {
+
+	// Give the cell back to the layer its page belongs to
+	for (int layer = 0; layer < BOX_TEXTURE_LAYERS; layer++) {
+		auto& pages = box_textures[layer];
+		if (std::find(pages.begin(), pages.end(), box->texture) != pages.end())
+			unused_box_textures[layer].push_front({ box->texture, box->texture_cell });
+	}
+	box->texture = 0;
+}
+
+DoorIndex& game::get_door_index(shared_ptr<Box> box) {
+	if (!box->door_index.dirty) return box->door_index;
+
+	// The box's own doors are anchored in the slot just inside them
+	box->door_index.clear();
+	for (auto door : box->doors)
+		if (door)
+			box->door_index.set(door, BOX_METERS_PER_SLOT * b2Vec2(door->slot->x + .5f, door->slot->y + .5f));
+
+	// Children's doors are anchored on their walls, and move with them
+	for (auto child : box->children)
+		update_door_anchors(child);
+	return box->door_index;
+}
+
+void game::update_door_anchors(shared_ptr<Box> box) {
+
+	// A dirty index will pick up the box's doors when it's rebuilt
+	if (!box->parent || !box->body || box->parent->door_index.dirty) return;
+	for (int face = 0; face < 4; face++) {
+		auto door = box->doors[face];
+		if (!door) continue;
+		b2Vec2 offset(face == Right ? 1.f : (face == Left ? -1.f : 0.f),
+					  face == Top ? -1.f : (face == Bottom ? 1.f : 0.f));
+		box->parent->door_index.set(door, box->body->GetPosition() + .5f * BOX_METERS_PER_SLOT * offset);
 	}
-	box->texture = texture;
+}
+
+shared_ptr<BoxDoor> game::find_nearest_door(Entity& entity, float radius, float& distance) {
+	distance = radius;
+	if (!entity.container || !entity.body) return 0;
+	return get_door_index(entity.container).find_nearest(entity.body->GetPosition(), radius, distance);
+}
+
+BoxPoint game::locate_point(shared_ptr<Box> box, b2Vec2 position, int max_depth) {
+	BoxPoint point = { box, position, 0 };
+	float slot_size = (float)BOX_PHYSICAL_SIZE / (float)BOX_SLOTS;
+	float half = .5f * (float)BOX_PHYSICAL_SIZE;
+
+	// Descend a level at a time by slot, rather than testing every child. A
+	// moving child can overlap the slots around its own, so check those too.
+	while (point.box && point.depth != max_depth) {
+		int sx = (int)floorf(point.position.x / slot_size);
+		int sy = (int)floorf(point.position.y / slot_size);
+		shared_ptr<Box> found = 0;
+		for (int x = std::max(sx - 1, 0); x <= std::min(sx + 1, BOX_SLOTS - 1) && !found; x++)
+		for (int y = std::max(sy - 1, 0); y <= std::min(sy + 1, BOX_SLOTS - 1) && !found; y++) {
+			auto child = point.box->slots[x][y].child;
+			if (!child || !child->body) continue;
+			auto offset = point.position - child->body->GetPosition();
+			if (fabsf(offset.x) < .5f * slot_size && fabsf(offset.y) < .5f * slot_size)
+				found = child;
+		}
+		if (!found) break;
+
+		// Into the child's world, the inverse of how the player exits it
+		auto offset = point.position - found->body->GetPosition();
+		point.position = b2Vec2(offset.x * (float)BOX_SLOTS + half, offset.y * (float)BOX_SLOTS + half);
+		point.box = found;
+		point.depth++;
+	}
+	return point;
+}
+
+void game::invalidate_box_nav(shared_ptr<Box> box) {
+
+	// A box's doors are also portals in its parent
+	pathfinder.invalidate(box.get());
+	if (box->parent)
+		pathfinder.invalidate(box->parent.get());
+}
+
+shared_ptr<const NavRoute> game::find_route(Entity& entity, shared_ptr<Box> to, int tx, int ty) {
+	if (!entity.container || !entity.body) return shared_ptr<const NavRoute>(new NavRoute());
+
+	// Start from the slot the entity is standing in
+	auto position = entity.body->GetPosition();
+	int sx = std::min(std::max((int)floorf(position.x / BOX_METERS_PER_SLOT), 0), BOX_SLOTS - 1);
+	int sy = std::min(std::max((int)floorf(position.y / BOX_METERS_PER_SLOT), 0), BOX_SLOTS - 1);
+	return find_route(entity.container, sx, sy, to, tx, ty);
+}
+
+shared_ptr<const NavRoute> game::find_route(shared_ptr<Box> from, int sx, int sy, shared_ptr<Box> to, int tx, int ty) {
+	return pathfinder.find_route(from, sx, sy, to, tx, ty);
+}
+
+bool game::get_flow_direction(Entity& entity, shared_ptr<BoxDoor> door, b2Vec2& direction) {
+	if (!entity.container || !entity.body) return false;
+	return get_flow_direction(entity.container, entity.body->GetPosition(), door, direction);
+}
+
+bool game::get_flow_direction(shared_ptr<Box> box, b2Vec2 position, shared_ptr<BoxDoor> door, b2Vec2& direction) {
+	auto field = pathfinder.get_flow_field(box, door);
+	if (!field) return false;
+
+	// Head for the middle of the next slot along the field
+	int sx = std::min(std::max((int)floorf(position.x / BOX_METERS_PER_SLOT), 0), BOX_SLOTS - 1);
+	int sy = std::min(std::max((int)floorf(position.y / BOX_METERS_PER_SLOT), 0), BOX_SLOTS - 1);
+	if (field->distances[sx][sy] < 0) return false;
+	int nx = sx + field->dx[sx][sy];
+	int ny = sy + field->dy[sx][sy];
+	direction = b2Vec2((nx + .5f) * BOX_METERS_PER_SLOT, (ny + .5f) * BOX_METERS_PER_SLOT) - position;
+	direction.Normalize();
+	return true;
 }
 
 void game::set_box_door(shared_ptr<Box> box, BoxFace face, int i, bool open) {
@@ -1136,21 +2236,37 @@ void game::set_box_door(shared_ptr<Box> box, BoxFace face, int i, bool open) {
 }
 
 void game::set_box_door(shared_ptr<Box> box, BoxFace face, Slot* slot, bool open) {
+	JournalScope journal_scope(journal);
+	JournalOp op(OpSetDoor, box);
+	op.face = face;
+	op.door_before = box->doors[(int)face];
+
+	// Put the door in place just as undo does, pairing it with its neighbours
 	auto door = shared_ptr<BoxDoor>(new BoxDoor(box, face, false, slot));
-	box->doors[(int)face] = door;
-	generate_box_edges(box);
-	generate_world_edges(box);
+	restore_box_door(box, face, door);
 
 	open_box_door(box, face, open);
+
+	op.door_after = door;
+	op.kept = (op.door_before ? sizeof(BoxDoor) : 0) + sizeof(BoxDoor);
+	if (journal_scope.is_outer())
+		journal.record(op);
 }
 
 void game::open_box_door(shared_ptr<Box> box, BoxFace face, bool open) {
 	if (!box->doors[face]) return;
+	JournalScope journal_scope(journal);
+	JournalOp op(OpOpenDoor, box);
+	for (int i = 0; i < 4; i++)
+		op.open_before[i] = box->doors[i] && box->doors[i]->open;
+
 	if (open)
 		for (int i = 0; i < 4; i++)
 			if (box->doors[i])
 				box->doors[i]->open = false;
 	box->doors[face]->open = open;
+	activate_box(box);
+	pathfinder.invalidate_routes();
 
 	generate_box_edges(box);
 	generate_world_edges(box);
@@ -1159,6 +2275,15 @@ void game::open_box_door(shared_ptr<Box> box, BoxFace face, bool open) {
 	for (auto child : box->children)
 		if (child->recursive)
 			open_box_door(child, face, open);
+
+	// Only journal opens which changed something
+	bool changed = false;
+	for (int i = 0; i < 4; i++) {
+		op.open_after[i] = box->doors[i] && box->doors[i]->open;
+		changed = changed || op.open_after[i] != op.open_before[i];
+	}
+	if (changed && journal_scope.is_outer())
+		journal.record(op);
 }
 
 void game::generate_box_edges(shared_ptr<Box> box) {
@@ -1189,7 +2314,7 @@ void game::generate_box_edges(shared_ptr<Box> box) {
 		if (!(door && door->open)) {
 			edge_shape.Set(a, b);
 			edge_fixture = box->body->CreateFixture(&edge_shape, 0);
-			edge_fixture->SetFriction(FRICTION);
+			edge_fixture->SetFriction(perf.friction);
 			edge_fixture->SetFilterData(filter);
 			box->body_edges[i_face] = edge_fixture;
 		}
@@ -1240,18 +2365,35 @@ void game::generate_world_edges(shared_ptr<Box> box) {
 			
 			edge_shape.Set(a, a0);
 			edge_fixture = box->world_edges->CreateFixture(&edge_shape, 0);
-			edge_fixture->SetFriction(FRICTION);
+			edge_fixture->SetFriction(perf.friction);
 			edge_fixture->SetFilterData(filter);
 
 			edge_shape.Set(b0, b);
 			edge_fixture = box->world_edges->CreateFixture(&edge_shape, 0);
-			edge_fixture->SetFriction(FRICTION);
+			edge_fixture->SetFriction(perf.friction);
 			edge_fixture->SetFilterData(filter);
+
+			// Add the exit portal, a sensor over the slot just outside the door
+			b2PolygonShape portal_shape;
+			float slot = BOX_METERS_PER_SLOT;
+			b2Vec2 center = .5f * (a0 + b0);
+			if (i_face == Top) center.y -= .5f * slot;
+			else if (i_face == Right) center.x += .5f * slot;
+			else if (i_face == Bottom) center.y += .5f * slot;
+			else if (i_face == Left) center.x -= .5f * slot;
+			portal_shape.SetAsBox(.5f * slot, .5f * slot, center, 0);
+			b2FixtureDef portal_def;
+			portal_def.shape = &portal_shape;
+			portal_def.isSensor = true;
+			portal_def.userData = box.get();
+			portal_def.filter.categoryBits = B2_CAT_PORTAL;
+			portal_def.filter.maskBits = B2_CAT_MAIN;
+			box->world_edges->CreateFixture(&portal_def);
 		}
 		else {
 			edge_shape.Set(a, b);
 			edge_fixture = box->world_edges->CreateFixture(&edge_shape, 0);
-			edge_fixture->SetFriction(FRICTION);
+			edge_fixture->SetFriction(perf.friction);
 			edge_fixture->SetFilterData(filter);
 		}
 	}
@@ -1262,6 +2404,10 @@ void game::set_player_container(shared_ptr<Box> box, b2Vec2 position) {
 }
 void game::set_player_container(shared_ptr<Box> box, b2Vec2 position, b2Vec2 velocity) {
 
+	// The player can't share a simulation, so entering an instance gives it a private copy
+	if (box && box->prototype)
+		make_box_unique(box);
+
 	// If we're transfering to "no-box", set the world as the outer-world
 	//auto world = (box ? (box->recursive ? box->parent->world : box->world) : outer_world);
 
@@ -1301,14 +2447,21 @@ void game::set_player_container(shared_ptr<Box> box, b2Vec2 position, b2Vec2 vel
 		}
 	}
 
+	// Both the box being left and the box being entered change
+	if (player.container)
+		touch_box(player.container);
+	if (box)
+		touch_box(box);
+
 	// Set the player container
 	//player.container = (box ? (box->recursive ? box->parent : box) : 0);
     player.set_container(box ? (box->recursive ? box->parent : box) : 0, position, velocity);
 }
 
 void game::center_view_on_slot(int sx, int sy, bool target) {
-	int x = ((BOX_SLOTS - 1) * .5f - sx) * PIXELS_PER_METER * BOX_METERS_PER_SLOT;
-	int y = ((BOX_SLOTS - 1) * .5f - sy) * PIXELS_PER_METER * BOX_METERS_PER_SLOT;
+	double slot_pixels = (double)BOX_RENDER_SIZE / (double)BOX_SLOTS;
+	double x = ((BOX_SLOTS - 1) * .5 - sx) * slot_pixels;
+	double y = ((BOX_SLOTS - 1) * .5 - sy) * slot_pixels;
 	if (target) {
 		view.tx = x;
 		view.ty = y;
@@ -1319,8 +2472,9 @@ void game::center_view_on_slot(int sx, int sy, bool target) {
 }
 
 void game::center_view_on_parent_slot(int sx, int sy, bool target) {
-	int x = -PIXELS_PER_METER * BOX_METERS_PER_SLOT * ((BOX_SLOTS - 1) * .5f - sx) / view.scale;
-	int y = -PIXELS_PER_METER * BOX_METERS_PER_SLOT * ((BOX_SLOTS - 1) * .5f - sy) / view.scale;
+	double slot_pixels = (double)BOX_RENDER_SIZE / (double)BOX_SLOTS;
+	double x = -slot_pixels * ((BOX_SLOTS - 1) * .5 - sx) / view.scale;
+	double y = -slot_pixels * ((BOX_SLOTS - 1) * .5 - sy) / view.scale;
 	if (target) {
 		view.tx = x;
 		view.ty = y;
@@ -5,11 +5,31 @@
 #include <list>
 #include <vector>
 #include <string>
+#include <algorithm>
+#include <functional>
 #include <math.h>
 #include <SFML/Graphics.hpp>
 #include "Box.h"
 #include "Player.h"
 #include "View.h"
+#include "Transform2d.h"
+#include "vec2f.h"
+#include "Profiler.h"
+#include "DebugDraw.h"
+#include "Atlas.h"
+#include "AssetLoader.h"
+#include "ShaderCache.h"
+#include "SoftRaster.h"
+#include "PortalListener.h"
+#include "RenderScale.h"
+#include "TextBatch.h"
+#include "Journal.h"
+#include "Pathfinder.h"
+#include "PerfProfile.h"
+#include "Telemetry.h"
+#include "DrawStats.h"
+#include "StressLevel.h"
+#include "MemoryReport.h"
 
 using std::shared_ptr;
 using std::unique_ptr;
@@ -25,28 +45,134 @@ public:
 	// Types
 	enum Mode { Play, Edit, Quit };
 
+	// A box's cell in a shared texture page
+	struct BoxTextureCell {
+		shared_ptr<BoxTexturePage> page;
+		int cell;
+	};
+
+	// A box drawn at editor thumbnail size, kept until the box changes
+	struct EditorThumbnail {
+		shared_ptr<sf::RenderTexture> texture;
+		int revision = -1;
+		int visible_frame = -1;
+	};
+
 public:
 	void setup();
+	void setup(const StressParams& params, bool headless, bool software = false);
 	void teardown();
 	void run();
+	void step(float dt);
+	void draw();
+	void draw_soft();
+	void record_frame_telemetry(float draw_time);
+	const SoftRaster* get_soft_texture(int box_id) const;
+	const vector<SoftCost>& get_soft_costs() const { return soft_costs; }
+	const list<shared_ptr<Box>>& get_boxes() const { return boxes; }
+	BoxMemory get_box_memory(shared_ptr<Box> box, int depth = 0);
+	vector<BoxMemory> get_memory_report();
+	size_t get_free_texture_memory();
+	string format_memory_report();
+
+	// Editor commands, each journaled as one edit for undo() and redo(). A slot
+	// can take a block or a box if it's free. On the edge, it can take its face's
+	// door, or open or close the door there.
+	enum EditTool { EditBlock, EditBox, EditDoor };
+	bool edit_slot(shared_ptr<Box> box, int sx, int sy, EditTool tool);
+	bool edit_push(shared_ptr<Box> box, int dx, int dy);
+	void undo();
+	void redo();
+	shared_ptr<Box> get_root_box() const { return root_box; }
+	const Journal& get_journal() const { return journal; }
+
+	// Routes through the box tree (see Pathfinder.h), from an entity or a slot
+	shared_ptr<const NavRoute> find_route(Entity& entity, shared_ptr<Box> to, int tx, int ty);
+	shared_ptr<const NavRoute> find_route(shared_ptr<Box> from, int sx, int sy, shared_ptr<Box> to, int tx, int ty);
+
+	// Which way to head for a door in the box, along its shared flow field
+	bool get_flow_direction(Entity& entity, shared_ptr<BoxDoor> door, b2Vec2& direction);
+	bool get_flow_direction(shared_ptr<Box> box, b2Vec2 position, shared_ptr<BoxDoor> door, b2Vec2& direction);
+
+	// Where frame timelines are written (F4, or on exit if trace_on_exit is set)
+	string trace_path = "trace.json";
+	bool trace_on_exit = false;
+
+	// Performance profile, read at setup and reloaded when the file changes
+	string perf_path = PERF_PROFILE_PATH;
+	PerfProfile perf;
+
+	// Per-step and per-frame records, written while open (see Telemetry.h)
+	Telemetry telemetry;
 
 private:
 	// Private game functions
+	void queue_assets();
+	void load_atlas();
+	void load_shader(sf::Shader& shader, const string& name);
+	void setup_world();
+	void setup_graphics(bool headless);
+	void generate_stress_level(const StressParams& params);
 	void set_mode(Mode new_mode);
-	void step(float dt);
-	void draw();
-	void get_view_transforms(sf::RenderStates& states);
+	void process_input();
+	void update_boxes(float dt);
+	void activate_box(shared_ptr<Box> box);
+	bool apply_journal_op(const JournalOp& op, bool forward);
+	bool detach_box(shared_ptr<Box> box);
+	bool attach_box(shared_ptr<Box> box);
+	bool holds_player(shared_ptr<Box> box);
+	void share_box_contents(shared_ptr<Box> box, shared_ptr<Box> prototype, shared_ptr<Box> contents);
+	void unshare_box_contents(shared_ptr<Box> box, shared_ptr<Box> contents);
+	void note_made_unique(JournalOp& op, shared_ptr<Box> box, shared_ptr<Box> prototype);
+	void restore_box_door(shared_ptr<Box> box, BoxFace face, shared_ptr<BoxDoor> door);
+	void set_box_doors_open(shared_ptr<Box> box, const bool open[4]);
+	void touch_box(shared_ptr<Box> box);
+	DoorIndex& get_door_index(shared_ptr<Box> box);
+	void update_door_anchors(shared_ptr<Box> box);
+	shared_ptr<BoxDoor> find_nearest_door(Entity& entity, float radius, float& distance);
+	void invalidate_box_nav(shared_ptr<Box> box);
+	BoxPoint locate_point(shared_ptr<Box> box, b2Vec2 position, int max_depth = -1);
+	void set_box_target(shared_ptr<Box> box, int sx, int sy);
+	int push_boxes(shared_ptr<Box> parent, const vector<BoxMove>& moves);
+	Transform2d get_view_transform();
 	void render_game();
 	void render_editor();
+	void render_profiler();
 	void render_box(shared_ptr<Box> box);
-	void render_child(shared_ptr<Box> parent, shared_ptr<Box> box);
+	EditorThumbnail& get_editor_thumbnail(shared_ptr<Box> box, unsigned int size);
+	void get_editor_layout(float& box_pad, float& box_size, int& boxes_per_row);
+	shared_ptr<Box> get_editor_slot(sf::Vector2f point, int& sx, int& sy);
+	void append_thumbnail_box(sf::VertexArray& verts, shared_ptr<Box> box, const sf::Transform& transform, float pixels);
+	void render_box_soft(shared_ptr<Box> box);
+	void render_children_soft(shared_ptr<Box> parent, SoftRaster& target, bool recursive);
+	void render_children(shared_ptr<Box> parent, bool recursive);
+	void append_box_quad(sf::VertexArray& verts, const sf::Transform& transform, sf::IntRect tex_rect, sf::Color color);
+	void append_atlas_quad(sf::VertexArray& verts, sf::FloatRect rect, sf::FloatRect tex_rect);
+	int get_block_quads(int sx, int sy, sf::IntRect block_rect, sf::FloatRect rects[4], sf::FloatRect tex_rects[4]);
+	bool get_box_door_transition(shared_ptr<Box> box, float& t, int& face, int& face_pos);
 	void render_box_fg(shared_ptr<Box> box);
+	string format_ms(float seconds);
+	string format_bytes(size_t bytes);
 	void get_box_shader(shared_ptr<Box> box, sf::RenderStates& states, bool door_shader = true, bool entropy_shader = true);
-	shared_ptr<Box> add_box(shared_ptr<Box> parent = 0, int sx = 0, int sy = 0, bool recursive = false);
+	shared_ptr<Box> add_box(shared_ptr<Box> parent = 0, int sx = 0, int sy = 0, bool recursive = false, shared_ptr<Box> prototype = 0);
+	shared_ptr<Box> add_prototype();
+	shared_ptr<Box> add_box_instance(shared_ptr<Box> parent, int sx, int sy, shared_ptr<Box> prototype);
+	void make_box_unique(shared_ptr<Box> box);
 	void add_box_hull(shared_ptr<Box> box, shared_ptr<b2World> world, float size, int sx, int sy);
 	void make_metabox(shared_ptr<Box> box, int sx, int sy);
 	void add_block(shared_ptr<Box> parent, int sx, int sy);
+	void remove_block(shared_ptr<Box> parent, int sx, int sy);
 	void assign_box_texture(shared_ptr<Box> box);
+	void release_box_texture(shared_ptr<Box> box);
+	int get_box_texture_layer(shared_ptr<Box> box);
+	void create_box_texture(BoxTexturePage& page);
+	sf::IntRect get_box_texture_rect(shared_ptr<Box> box);
+	sf::RenderTexture& get_box_target(shared_ptr<Box> box);
+	void set_box_texture_size(unsigned int size);
+	void apply_perf_profile();
+	void draw_counted(sf::RenderTarget& target, const sf::Drawable& drawable,
+					  const sf::RenderStates& states = sf::RenderStates::Default);
+	float get_texture_scale(const sf::Sprite& sprite);
 	void set_box_door(shared_ptr<Box> box, BoxFace face, int i, bool open = false);
 	void set_box_door(shared_ptr<Box> box, BoxFace face, Slot* slot, bool open);
 	void open_box_door(shared_ptr<Box> box, BoxFace, bool open);
@@ -68,20 +194,49 @@ private:
 	shared_ptr<b2World> outer_world;
 	shared_ptr<Box> root_box;
 	list<shared_ptr<Box>> boxes;
-	list<shared_ptr<sf::RenderTexture>> box_textures;
-	list<shared_ptr<sf::RenderTexture>> unused_box_textures;
+	list<shared_ptr<Box>> prototypes;
+	list<shared_ptr<Box>> active_boxes;
+	list<shared_ptr<BoxTexturePage>> box_textures[BOX_TEXTURE_LAYERS];	// pages
+	list<BoxTextureCell> unused_box_textures[BOX_TEXTURE_LAYERS];
+	unsigned int max_box_texture_columns = 0;
 	unique_ptr<sf::RenderWindow> window;
 	View view;
+	AssetLoader assets;
 	sf::Font font;
-	sf::Texture box_bg;
-	sf::Texture box_fg;
-	sf::Texture grid;
-	sf::Texture player_tex;
-	sf::Texture block_tex;
+	Atlas atlas;
+	ShaderCache shader_cache;
+	Journal journal;
+	Pathfinder pathfinder;
+	int tree_revision = 0;
+	float editor_scroll = 0;
+	int editor_layout_revision = -1;
+	vector<shared_ptr<Box>> editor_boxes;
+	map<int, int> editor_layout;
+	shared_ptr<Box> editor_selection;	// the child box the arrow keys push
+	map<int, EditorThumbnail> editor_thumbnails;
+	vector<shared_ptr<sf::RenderTexture>> unused_editor_thumbnails;
+	RenderScale render_scale;
+	unsigned int box_texture_size = BOX_RENDER_SIZE;
+	PortalListener portal_listener;
+	bool software = false;
+	map<int, SoftRaster> soft_textures;
+	map<int, SoftRaster> soft_back_textures;
+	vector<SoftCost> soft_costs;
 	sf::Shader meta_box_shader;
 	sf::Shader meta_door_shader;
+	sf::Shader meta_box_batch_shader;
+	DebugDraw debug_draw;
+	TextBatch text_batch;
 	int next_box_id;
+	int frame = 0;
+	int step_count = 0;
+	int boxes_rendered = 0;
+	DrawStats draw_stats;
+	sf::Clock telemetry_clock;
+	size_t telemetry_memory = 0;
 	float fps;
+	Profiler profiler;
+	bool show_profiler = false;
 	Player player;
 	shared_ptr<BoxDoor> nearest_door;
 	BoxFace nearest_door_face;
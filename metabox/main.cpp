@@ -2,6 +2,27 @@
 
 int main(int argc, char *argv[]) {
 	game g;
+
+	// --trace [path] writes a Chrome trace of the session on exit
+	// --perf <preset|path> starts from a preset, or reads another profile file
+	// --telemetry <path.csv|path.jsonl> streams per-step and per-frame records
+	for (int i = 1; i < argc; i++) {
+		if (string(argv[i]) == "--telemetry" && i + 1 < argc)
+			g.telemetry.open(argv[++i]);
+		if (string(argv[i]) == "--perf" && i + 1 < argc) {
+			string value = argv[++i];
+			if (g.perf.set_preset(value))
+				g.perf_path = "";
+			else
+				g.perf_path = value;
+		}
+		if (string(argv[i]) == "--trace") {
+			g.trace_on_exit = true;
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				g.trace_path = argv[++i];
+		}
+	}
+
 	g.setup();
 	g.run();
 	return 0;
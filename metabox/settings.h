@@ -4,8 +4,13 @@
 #define BOX_METERS_PER_SLOT ((float)BOX_PHYSICAL_SIZE/(float)BOX_SLOTS)
 #define BOX_PIXELS_PER_SLOT ((float)BOX_RENDER_SIZE/(float)BOX_SLOTS)
 #define PIXELS_PER_METER ((float)BOX_RENDER_SIZE/(float)BOX_PHYSICAL_SIZE)
+#define BOX_TEXTURE_PAGE_COLUMNS 4 // box textures per side of a shared texture page
+#define BOX_TEXTURE_LAYERS 3 // sets of pages: two alternating with depth, so children aren't drawn from their parent's page, and one for prototypes
 #define FRICTION .4f
+#define BOX_SETTLE_DISTANCE .001f // meters from its target slot at which a box snaps and sleeps
 #define GRAVITY 40//9.8
+#define EDITOR_THUMBNAIL_MIN_BOX 4 // pixels; boxes smaller than this in a thumbnail are drawn without their contents
 
 #define B2_CAT_MAIN 1
-#define B2_CAT_BOX_HULL 1<<1
\ No newline at end of file
+#define B2_CAT_BOX_HULL 1<<1
+#define B2_CAT_PORTAL 1<<2 // door sensors, touched only by entities
\ No newline at end of file